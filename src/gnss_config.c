@@ -24,9 +24,22 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <stddef.h>
+#include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
 #include "hardware/irq.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "pico/i2c_slave.h"
+#include "pico/stdio_usb.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/structs/timer.h"
 
 #define UART_ID uart1   // change as needed
 #define BAUD_RATE 115200  // default BAUD rate for the module for initial connection. can be changed later.
@@ -36,10 +49,624 @@
 #define UART_TX_PIN 4   // change as needed
 #define UART_RX_PIN 5   // change as needed
 
+// optional hardware flow control on UART_ID. the pico's RTS is also dropped while
+// the frame pool or raw ring is nearly full, not only the PL011 FIFO. u-blox
+// modules seldom bring their handshake lines out, so the wiring is probed first.
+#define FLOW_CTS_PIN 26  // the module's RTS, uart1 CTS
+#define FLOW_RTS_PIN 27  // the module's CTS, uart1 RTS
+#define FLOW_CTS 0x01
+#define FLOW_RTS 0x02
+#define FLOW_STOP_FREE 2    // drop RTS at this many free frame buffers or raw records
+#define FLOW_RESUME_FREE 6  // and raise it again at this many
+#define FLOW_BENCH_S 10     // per mode, at BATCH_RETRIEVE_BAUD
+#define FLOW_BENCH_PERIOD_MS 100  // nav rate during the comparison, for volume
+#define FLOW_STALL_US 1000  // interrupts held off this long, eg. a flash page program
+#define FLOW_STALL_PERIOD_MS 20
+
+// build with -DRAM_HOT_PATHS to run the RX interrupt and everything it calls from
+// SRAM, with their tables, instead of through the XIP cache. a cache miss there
+// costs a QSPI read per line and shows up as jitter in the interrupt. the timer,
+// atoi, strncmp, strlen and toupper are replaced by the rx_time_us() and nmea_*
+// helpers for this. memcpy and memset go to the bootrom, but integer division
+// only leaves flash if PICO_DIVIDER_IN_RAM=1 is defined as well.
+#ifdef RAM_HOT_PATHS
+#define HOT_FUNC(name) __not_in_flash_func(name)
+#define HOT_DATA __not_in_flash("hot")
+#else
+#define HOT_FUNC(name) name
+#define HOT_DATA
+#endif
+#define HOT_BENCH_EPOCHS 200  // synthetic epochs per pass of the hot path benchmark
+
+#define UBX_SYNC_CHAR_1 0xB5
+#define UBX_SYNC_CHAR_2 0x62
+#define UBX_MAX_PAYLOAD 1024  // largest UBX payload buffered by the RX parser
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MGA 0x13
+#define UBX_CLASS_MON 0x0A
+#define UBX_CLASS_LOG 0x21
+#define UBX_CLASS_RXM 0x02
+#define UBX_CLASS_ACK 0x05
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_NAV_POSECEF 0x01
+#define UBX_NAV_STATUS 0x03
+#define UBX_NAV_PVT 0x07
+#define UBX_NAV_SAT 0x35
+#define UBX_NAV_GEOFENCE 0x39
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_RATE 0x08
+#define UBX_CFG_NAVX5 0x23
+#define UBX_MGA_ACK 0x60
+#define UBX_MGA_DBD 0x80
+#define UBX_CFG_BATCH 0x93
+#define UBX_CFG_VALSET 0x8A
+#define UBX_CFG_VALGET 0x8B
+#define UBX_CFG_CFG 0x09
+#define UBX_CFG_RXM 0x11
+#define UBX_CFG_PM2 0x3B
+#define UBX_CFG_GEOFENCE 0x69
+#define UBX_MON_BATCH 0x32
+#define UBX_LOG_RETRIEVEBATCH 0x10
+#define UBX_LOG_BATCH 0x11
+#define UBX_RXM_SFRBX 0x13
+#define UBX_RXM_RAWX 0x15
+
+// the navigation database cache lives in the last sectors of the pico's flash
+#define NAV_DB_FLASH_SIZE (8 * FLASH_SECTOR_SIZE)  // 32 KB, a full M8 dump is well below this
+#define NAV_DB_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - NAV_DB_FLASH_SIZE)
+#define NAV_DB_MAGIC 0x4244564E  // "NVDB"
+#define NAV_DB_QUIET_MS 1000  // the MGA-DBD dump is considered complete after this long without a message
+#define MGA_ACK_TIMEOUT_MS 100  // max time to wait for an MGA-ACK before sending the next message
+#define MGA_UNACKED_GAP_MS 10  // pacing used when the module doesn't send MGA-ACKs
+#define TTFF_TIMEOUT_MS 300000
+
+// AssistNow Offline / Autonomous blob, written raw below the nav database cache, eg.
+// `picotool load mgaoffline.ubx -t bin -o <XIP_BASE + MGA_BLOB_FLASH_OFFSET>`
+#define MGA_BLOB_FLASH_SIZE (32 * FLASH_SECTOR_SIZE)  // 128 KB, about 5 weeks of GPS+GLONASS AssistNow Offline
+#define MGA_BLOB_FLASH_OFFSET (NAV_DB_FLASH_OFFSET - MGA_BLOB_FLASH_SIZE)
+#define MGA_STDIN_TIMEOUT_US 2000000  // end of a file piped over USB
+
+// prebuilt frame sequences switching between every pair of mission profiles,
+// below the AssistNow blob
+#define TRANSITION_FLASH_SIZE FLASH_SECTOR_SIZE
+#define TRANSITION_FLASH_OFFSET (MGA_BLOB_FLASH_OFFSET - TRANSITION_FLASH_SIZE)
+#define TRANSITION_MAGIC 0x534E5254  // "TRNS"
+#define PROFILE_MAX_ITEMS 16
+#define MAX_PROFILES 4
+
+// write-ahead journal of the configuration in progress, one record per flash page
+// in two sectors used in turn, so erasing one never loses the latest record
+#define JOURNAL_FLASH_SIZE (2 * FLASH_SECTOR_SIZE)
+#define JOURNAL_FLASH_OFFSET (TRANSITION_FLASH_OFFSET - JOURNAL_FLASH_SIZE)
+#define JOURNAL_SLOTS (JOURNAL_FLASH_SIZE / FLASH_PAGE_SIZE)
+#define JOURNAL_MAGIC 0x4C4E524A  // "JRNL"
+#define JOURNAL_TARGET_BAUD 230400  // the journaled configuration ends with this baud, change as needed
+
+#define NAV_PERIOD_MS 1000  // the module's measurement period (CFG-RATE), 1 Hz by default
+#define BATCH_MAX_EPOCHS 256  // fixes kept on the pico per retrieval
+#define BATCH_RETRIEVE_BAUD 921600  // baud used for the retrieval burst
+#define BATCH_QUIET_MS 500  // retrieval is done after this long without a LOG-BATCH
+#define LOG_BATCH_LEN 100  // payload size of a UBX-LOG-BATCH message
+#define NAV_PVT_LEN 92  // payload size of a UBX-NAV-PVT message
+#define MAX_FIX_WAITERS 8  // consumers that can wait on the same position poll
+#define PVT_POLL_TIMEOUT_MS 1500  // resend a poll that wasn't answered within this
+#define REPLAY_TIMEOUT_US 2000000  // end of a log replayed over USB
+
+// velocity-adaptive navigation rate. the controller steps between these periods,
+// up when the ground speed passes rate_up_speed and down when it drops below
+// rate_down_speed; the gap between the two is the hysteresis.
+#define RATE_STEPS 4
+#define RATE_MIN_DWELL_MS 3000  // minimum time between two rate changes
+#define RATE_MAX_H_ACC 10000  // mm, fixes less accurate than this don't change the rate
+
+// MAVLink GPS output to a flight controller on the pico's other UART. stdio has to be
+// USB only (pico_enable_stdio_uart off), otherwise it shares uart0 with this.
+#define MAVLINK_UART_ID uart0
+#define MAVLINK_BAUD_RATE 115200
+#define MAVLINK_TX_PIN 0
+#define MAVLINK_RX_PIN 1
+#define MAVLINK_SYSTEM_ID 1
+#define MAVLINK_COMPONENT_ID 220  // MAV_COMP_ID_GPS
+#define MAVLINK_STX 0xFD  // MAVLink 2
+#define MAVLINK_HEADER_LEN 10
+#define MAVLINK_MAX_FRAME (MAVLINK_HEADER_LEN + 255 + 2)
+#define MAVLINK_MSG_GPS_RAW_INT 24
+#define MAVLINK_MSG_GPS_RAW_INT_LEN 52  // including the extension fields
+#define MAVLINK_MSG_GPS_RAW_INT_CRC 24
+#define MAVLINK_MSG_GPS_INPUT 232
+#define MAVLINK_MSG_GPS_INPUT_LEN 65
+#define MAVLINK_MSG_GPS_INPUT_CRC 151
+#define GPS_UNIX_OFFSET_S 315964800  // 1980-01-06 in unix time
+#define GPS_LEAP_SECONDS 18
+#define STATS_INTERVAL_MS 10000  // how often the main loop prints its stats
+
+// NMEA re-synthesized from decoded fixes, for consumers that only speak NMEA. on
+// uart0 it takes MAVLink's place, and its DMA channel.
+#define NMEA_OUT_TALKER "GN"  // combined constellations, "GP" for consumers that only know GPS
+#define NMEA_OUT_MAX (3 * NMEA_MAX_LEN)  // GGA, RMC and ZDA of one epoch
+
+// register map of the latest fix served as an I2C slave, for hosts that would
+// rather read a fixed block than parse a stream. the host writes a register
+// offset, then reads from it; one read transaction always sees one epoch.
+#define REGMAP_I2C_ID i2c1
+#define REGMAP_I2C_ADDRESS 0x42
+#define REGMAP_I2C_BAUD 400000
+#define REGMAP_SDA_PIN 6
+#define REGMAP_SCL_PIN 7
+#define REGMAP_VERSION 1  // bump when regmap_t changes
+
+// geofences evaluated by the module, which drives one of its PIOs with the combined
+// state. wire that PIO to GEOFENCE_WAKE_PIN.
+#define GEOFENCE_MAX 4  // the M8 evaluates up to four
+#define GEOFENCE_CONF_LEVEL 3  // 0-5, sigmas the position must be in or out by (3 = 99.7%)
+#define GEOFENCE_MODULE_PIO 3
+#define GEOFENCE_WAKE_PIN 8
+#define CM_PER_1E7_DEG 1.11319f  // along a meridian, and along the equator
+
+// local North-East-Down around a home point, in mm, without floating point per
+// conversion. lat/lon/height go through a tangent plane expansion with second
+// order terms, ECEF through the exact rotation; both use coefficients worked out
+// once per home point.
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+#define NED_BENCH_POINTS 64  // per range in the validation
+
+// dead reckoning between fixes: the last fix, its velocity and the acceleration
+// since the fix before, extrapolated to any pico time. the writer works out the
+// scale factors once per fix, a query is a handful of integer multiplies.
+#define DR_HORIZON_MS 1000  // queries further than this past the last fix are clamped to it
+#define DR_MAX_GAP_MS 2000  // no acceleration across a longer gap between fixes
+#define DR_MAX_ACCEL 20000  // mm/s^2, anything above is a glitch in the velocity
+#define DR_OUTPUT_LATENCY_US 0  // epoch to the module starting to send, invisible in rx_us; measure against the time pulse
+#define DR_RESYNC_US 1000000  // a jump in the epoch to pico time offset this big restarts it (week or day rollover)
+#define DR_K_LAT0 24276483  // 1e-7 deg of latitude per mm at the equator, 1 / (a (1 - e^2)), Q28
+#define DR_K_LAT1 243774    // its decrease with sin^2 lat, first order in e^2, Q28
+#define DR_K_LON0 24113967  // 1e-7 deg of longitude per mm times cos lat, 1 / a, Q28
+#define DR_K_LON1 80714     // its decrease with sin^2 lat, Q28
+#define DR_MIN_COS (1 << 24)  // cos lat clamp, Q30 (89 deg), keeps k_lon in range near the poles
+
+// reading the module over DDC (its I2C slave port) as well as the UART. the module
+// raises txReady on one of its PIOs once more than a threshold of bytes is pending,
+// so the pico only touches the bus when there's something to read.
+#define DDC_I2C_ID i2c0  // i2c1 is the register map's slave
+#define DDC_I2C_ADDRESS 0x42
+#define DDC_I2C_BAUD 400000
+#define DDC_SDA_PIN 12
+#define DDC_SCL_PIN 13
+#define DDC_REG_AVAIL 0xFD  // bytes pending, big endian, followed by the stream at 0xFF
+#define TXREADY_PIN 14
+#define TXREADY_MODULE_PIO 6  // change as needed, whichever PIO the module brings out
+#define TXREADY_THRESHOLD 64  // bytes, rounded up to 8, 0 to poll instead
+#define DDC_POLL_MS 10  // without txReady
+#define DDC_BURST_MIN 32  // smallest read, for low thresholds
+#define DDC_BURST_MAX 256
+#define DDC_BENCH_S 20  // per threshold
+#define DDC_LATENCY_SAMPLES 64
+#define DDC_UART_REF_S 5  // NAV-PVT over the UART before each threshold, the latency reference
+
+// received frames are copied once into a buffer from a fixed pool, which every
+// interested sink (USB log, MAVLink, ...) then references until it's done with it
+#define NMEA_MAX_LEN 128  // longer than the standard 82 for PUBX sentences
+#define FRAME_MAX_LEN (UBX_MAX_PAYLOAD + 8)
+#define FRAME_POOL_SIZE 12
+#define SINK_QUEUE_LEN 8  // frames a sink can fall behind by, power of two
+#define FRAME_UBX 0
+#define FRAME_NMEA 1
+#define FILTER_NONE 0x00
+#define FILTER_ANY 0xFF
+
+// incremental satellite table, indexed by UBX gnssId and a per-constellation slot
+#define SAT_GNSS 7  // GPS, SBAS, Galileo, BeiDou, IMES, QZSS, GLONASS
+#define SAT_SLOTS 64
+#define SAT_STRONG_CNO 35  // dBHz, counted separately in the summaries
+#define SAT_PENDING_MAX 32  // changes held back until a GSV group completes
+#define NMEA_MAX_FIELDS 24
+#define NMEA_CACHE_SLOTS 16  // GSV parts remembered for the unchanged-sentence check
+
+// fields of nav_fix_t a consumer can subscribe to. decoders skip, and for NMEA
+// don't even split, whatever nobody subscribed to. define FIX_FIELDS at build
+// time to fix the set, the checks then fold to constants.
+#define FIX_TIME 0x01      // itow, hour, min, sec, nano
+#define FIX_DATE 0x02      // year, month, day, valid
+#define FIX_QUALITY 0x04   // fix_type, flags, num_sv
+#define FIX_POSITION 0x08  // lat, lon
+#define FIX_ALTITUDE 0x10  // height, h_msl
+#define FIX_VELOCITY 0x20  // vel_n, vel_e, vel_d, g_speed, head_mot
+#define FIX_ACCURACY 0x40  // h_acc, v_acc, s_acc, p_dop
+#define FIX_ALL 0x7F
+#ifdef FIX_FIELDS
+#define fix_fields() (FIX_FIELDS)
+#else
+#define fix_fields() (fix_field_mask)
+#endif
+#define BENCH_ITERATIONS 1000
+
+// RXM-RAWX and RXM-SFRBX (raw measurement firmware, eg. M8T) can be several KB. they
+// aren't buffered, records are cut out of the payload as it arrives and handed to
+// the main loop, which only trusts them once the checksum has been seen.
+#define RAW_RING_LEN 16  // records the main loop can fall behind by, power of two
+#define RAW_RECORD_MAX 48  // SFRBX payload with 10 words, RAWX measurement with its epoch
+#define RAW_MARKER 0  // msg_id of the end of frame record carrying the checksum verdict
+#define RAW_OK 1
+#define RAW_BAD 2
+#define RAWX_HEADER_LEN 16
+#define RAWX_MEAS_LEN 32
+#define RAWX_KEPT 10  // rcvTow and week, copied in front of every measurement
+#define RAWX_MAX_LEN (RAWX_HEADER_LEN + 64 * RAWX_MEAS_LEN)  // more measurements than any receiver tracks, ie. a corrupt length
+#define SFRBX_MAX_LEN (8 + 4 * 16)  // 16 words, Galileo I/NAV on Gen9
+#define RAW_SOURCE_UART 0
+#define RAW_SOURCE_DDC 1
+#define RAW_SOURCES 2  // framers feeding the ring, the main loop tracks each one's frame separately
+#define RAW_BENCH_MEAS 32  // measurements in the synthetic benchmark frame, 1040 byte payload
+#define LINK_921600_BPS 92160  // 921600 baud 8N1
+
+// configuration profiles. Gen9 and later modules take key-value items in
+// UBX-CFG-VALSET, the M8 only the per-item legacy messages
+#define CFG_LAYER_RAM 0x01
+#define CFG_LAYER_BBR 0x02
+#define CFG_LAYER_FLASH 0x04
+#define CFG_VALSET_MAX_ITEMS 64  // per VALSET or VALGET, protocol limit
+#define CFG_ACK_TIMEOUT_MS 500
+#define CFG_BACKEND_UNKNOWN 0
+#define CFG_BACKEND_LEGACY 1  // PUBX,40, CFG-MSG, CFG-RATE, then CFG-CFG to save
+#define CFG_BACKEND_VALSET 2
+#define CFG_LEGACY_NMEA 0  // legacy equivalent of an item: PUBX,40 for `nmea`
+#define CFG_LEGACY_MSG 1   // CFG-MSG for msg_class/msg_id
+#define CFG_LEGACY_RATE 2  // CFG-RATE measurement period
+
+// receiver power save, CFG-PM2 and CFG-RXM
+#define PM2_ONOFF 0   // sleep between fixes, reacquire each time
+#define PM2_CYCLIC 1  // keep tracking, duty cycle the RF
+#define PM_REACQUIRE_MS 1000  // hot start after an OFF period, fixes in it are lost
+
+// stack painting. each core's stack is filled with STACK_PAINT below the frames
+// in use, the deepest word that was overwritten since is the high water mark.
+#define STACK_PAINT 0xDEADBEEF
+#define STACK_PAINT_MARGIN 64  // bytes below the painting function's own frame left alone
+
+// load-driven sys_clk governor. clk_peri is moved to the 48 MHz USB PLL first, so the
+// UART dividers stop depending on sys_clk and the UARTs keep running while clk_sys is
+// switched. the I2C blocks run from clk_sys, their timing is redone after every step.
+// load is the share of main loop time above an idle pass.
+#define GOV_PERI_HZ (48 * MHZ)
+#define GOV_MIN_KHZ 48000   // bounds of the steps the governor may use
+#define GOV_MAX_KHZ 133000  // highest rated without raising the core voltage
+#define GOV_WINDOW_MS 500   // load and pressure are taken over this
+#define GOV_MAX_LOAD 60     // %, step up above this, the rest is headroom for bursts
+#define GOV_DOWN_LOAD 40    // %, step down only if the load at the lower step stays below this
+#define GOV_DOWN_WINDOWS 4  // quiet windows in a row before stepping down
+#define GOV_UP_PRESSURE 50  // %, a sink queue, the frame pool or the raw ring this full goes to the top step
+#define GOV_DOWN_PRESSURE 25
+#define GOV_MAX_BAUD_ERROR_PPM 10000  // 1%, worst UART divisor error accepted at GOV_PERI_HZ
+#define GOV_BASE_UA 6000    // rough RP2040 supply current: a fixed part, plus one proportional
+#define GOV_UA_PER_MHZ 140  // to clk_sys. measure your board and adjust
+
+typedef enum {
+    UBX_WAIT_SYNC_1,
+    UBX_WAIT_SYNC_2,
+    UBX_CLASS,
+    UBX_ID,
+    UBX_LEN_1,
+    UBX_LEN_2,
+    UBX_PAYLOAD,
+    UBX_CK_A,
+    UBX_CK_B
+} ubx_rx_state_t;
+
+typedef struct {
+    uint8_t msg_id;  // UBX_RXM_RAWX, UBX_RXM_SFRBX or RAW_MARKER
+    uint8_t status;  // markers only: RAW_OK or RAW_BAD
+    uint16_t frame;  // sequence number of the frame it was cut from
+    uint8_t source;  // framer it came from, RAW_SOURCE_UART or RAW_SOURCE_DDC
+    uint8_t len;
+    uint8_t data[RAW_RECORD_MAX];
+} raw_record_t;
+
+typedef struct {
+    ubx_rx_state_t state;
+    uint8_t msg_class;
+    uint8_t msg_id;
+    uint16_t len;
+    uint16_t idx;
+    uint8_t ck_a;
+    uint8_t ck_b;
+    uint8_t streaming;  // the payload goes to raw_stream_byte(), not the buffer
+    uint8_t source;     // RAW_SOURCE_*, tags the streamed records
+    uint16_t raw_frame;  // sequence number of the streamed frame in progress
+    uint8_t frames_only;  // check frames but leave them in payload for the caller, nothing is handled or published
+    raw_record_t raw_rec;   // record being cut out of the frame, copied to the ring once complete
+    raw_record_t *raw_open;  // &raw_rec while it's being filled, NULL if it was dropped
+    uint8_t raw_kept[RAWX_KEPT];  // rcvTow and week of the RAWX frame in progress
+    uint8_t payload[UBX_MAX_PAYLOAD];
+} ubx_rx_t;
+
+typedef struct {
+    uint32_t key;       // configuration key id, the size of the value is in bits 28-30
+    uint32_t value;
+    uint8_t legacy;     // CFG_LEGACY_*, how an M8 gets the same setting
+    const char *nmea;
+    uint8_t msg_class;
+    uint8_t msg_id;
+} cfg_item_t;
+
+typedef struct {
+    const char *name;
+    const cfg_item_t *items;
+    int num_items;
+} mission_profile_t;
+
+typedef struct {
+    uint16_t offset;  // into the image
+    uint16_t len;
+    uint8_t acks;     // UBX frames in it, each answered with an ACK
+    uint8_t messages;
+} transition_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t hash;          // of the profiles and the backend the frames were built for
+    uint16_t num_profiles;
+    uint16_t len;           // whole image, header included
+    transition_t table[(MAX_PROFILES + 1) * MAX_PROFILES];  // [from][to], from = num_profiles is "unknown"
+} transition_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // the highest valid one is current
+    uint32_t txn;           // hash of the configuration being applied
+    uint16_t step;          // steps acknowledged so far
+    uint16_t num_steps;
+    uint32_t baud;          // the module's baud as last confirmed
+    uint32_t pending_baud;  // baud change sent but not yet confirmed, 0 if none
+    uint32_t cold_us;       // how long the last apply from scratch took
+    uint16_t crc;           // CRC-16/X.25 of everything above
+} journal_record_t;
+
+typedef struct {
+    int32_t lat;  // deg * 1e-7
+    int32_t lon;
+    uint32_t radius_cm;
+} geofence_t;
+
+typedef struct {
+    const char *name;
+    uint8_t lp_mode;         // CFG-RXM: 0 continuous, 1 power save with the CFG-PM2 settings
+    uint8_t mode;            // PM2_ONOFF or PM2_CYCLIC
+    uint32_t update_ms;      // time between fixes
+    uint32_t search_ms;      // retry period after a failed acquisition
+    uint16_t on_time_s;      // ON/OFF: time to stay on after a fix
+} pm_profile_t;
+
+typedef struct {
+    uint32_t epochs;      // NAV-PVT epochs that would have been output
+    uint32_t fixes;       // of those, with gnssFixOK
+    uint32_t gaps;        // intervals between consecutive fixes
+    uint64_t gap_sum_ms;
+    uint32_t max_gap_ms;  // longest gap between consecutive fixes
+    uint64_t h_acc_sum;   // mm, over the fixes
+    uint32_t last_itow;
+    uint32_t last_period; // update period of the last kept epoch
+} pm_stats_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;       // bytes of MGA-DBD frames following the header
+    uint32_t num_msgs;
+    uint32_t checksum;  // byte sum of the frames, catches a half-written cache
+} nav_db_header_t;
+
+typedef struct {
+    char line[NMEA_MAX_LEN];
+    uint16_t len;  // 0 while waiting for a `$`
+    uint8_t checksum;  // running XOR of the bytes between `$` and `*`
+    uint8_t sum_a;  // running fletcher sums over the same bytes. the XOR alone
+    uint8_t sum_b;  // misses eg. "46" -> "57", these make the hash worth trusting
+    uint16_t star;  // position of the `*`, 0 until it's seen
+} nmea_rx_t;
+
+typedef struct {
+    char key[6];       // talker and type, eg. "GPGSV"
+    uint8_t part;      // GSV part number
+    uint16_t len;
+    uint32_t hash;     // checksum and fletcher sums of the sentence
+    uint64_t seen;     // GSV: slots the part reported
+    uint32_t group;    // GSV: group the part was decoded in
+    uint8_t applied;   // GSV: that group was committed to the table
+} nmea_cache_t;
+
+typedef struct {
+    uint8_t visible;   // SVs in the table
+    uint8_t tracked;   // of those, with a C/N0
+    uint8_t strong;    // with C/N0 >= SAT_STRONG_CNO
+    uint16_t cno_sum;  // dBHz, over the tracked ones
+} sat_summary_t;
+
+typedef struct {
+    uint8_t slot;
+    uint8_t cno;
+    int8_t elev;
+    int16_t azim;
+} sat_change_t;
+
+typedef struct {
+    uint8_t type;       // FRAME_UBX or FRAME_NMEA
+    uint8_t msg_class;  // UBX only
+    uint8_t msg_id;
+    uint8_t refs;       // sinks still holding the frame
+    uint16_t len;
+    uint64_t rx_us;
+    uint8_t data[FRAME_MAX_LEN];  // the complete frame or sentence as received
+} frame_t;
+
+typedef struct {
+    const char *name;
+    int enabled;
+    int nmea;           // 1 to receive NMEA sentences
+    uint8_t ubx_class;  // UBX class to receive, FILTER_NONE or FILTER_ANY
+    uint8_t ubx_id;     // UBX id within that class, or FILTER_ANY
+    uint16_t decimate;  // deliver every nth frame that passes the filter
+    int (*write)(const frame_t *frame);  // must not block, returns 0 to have the frame retried
+    uint8_t queue[SINK_QUEUE_LEN];  // pool indices
+    volatile uint8_t head;  // only written by the RX interrupt
+    volatile uint8_t tail;  // only written by the main loop
+    uint16_t skip;      // frames to pass over before the next one is delivered
+    uint32_t delivered;
+    uint32_t dropped;   // queue full or pool empty, never holds up the other sinks
+    uint8_t max_backlog;
+} sink_t;
+
+typedef struct {
+    uint32_t itow;      // GPS time of week, ms
+    uint16_t year;      // UTC
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;      // NAV-PVT validity flags, bit0 date, bit1 time
+    int32_t nano;       // fraction of the second, ns
+    uint8_t fix_type;   // 0 no fix, 2 2D, 3 3D, 4 GNSS + dead reckoning
+    uint8_t flags;      // bit0 gnssFixOK
+    uint8_t num_sv;
+    int32_t lon;        // 1e-7 deg
+    int32_t lat;        // 1e-7 deg
+    int32_t height;     // above the ellipsoid, mm
+    int32_t h_msl;      // above mean sea level, mm
+    uint32_t h_acc;     // mm
+    uint32_t v_acc;     // mm
+    int32_t vel_n;      // mm/s
+    int32_t vel_e;      // mm/s
+    int32_t vel_d;      // mm/s
+    int32_t g_speed;    // ground speed, mm/s
+    int32_t head_mot;   // heading of motion, 1e-5 deg
+    uint32_t s_acc;     // speed accuracy, mm/s
+    uint16_t p_dop;     // 0.01
+    uint64_t rx_us;     // pico time when the frame was received
+} nav_fix_t;
+
+typedef void (*fix_callback_t)(const nav_fix_t *fix);
+
+typedef struct {
+    int32_t lat;        // home, 1e-7 deg
+    int32_t lon;
+    int32_t height;     // above the ellipsoid, mm
+    int32_t ecef[3];    // home in ECEF, cm
+    int32_t k_n;        // mm per 1e-7 deg of latitude, Q16
+    int32_t k_e;        // mm per 1e-7 deg of longitude at the home latitude, Q16
+    int32_t k_e_lat;    // change of k_e per 1e-7 deg of latitude, Q40
+    int32_t k_n_lat2;   // north per 1e-7 deg of latitude squared (meridian radius change), Q40
+    int32_t k_n_lon2;   // north per 1e-7 deg of longitude squared (the parallel curving away), Q40
+    int32_t k_n_h;      // change of k_n per mm of height above home, Q44
+    int32_t k_e_h;      // the same for k_e
+    int32_t k_d_n;      // 1 / 2(M + h), drop below the tangent plane per mm north squared, Q48
+    int32_t k_d_e;      // 1 / 2(N + h), the same east
+    int32_t rot[3][3];  // ECEF to NED, Q30
+} ned_home_t;
+
+typedef struct {
+    int32_t n;  // mm
+    int32_t e;
+    int32_t d;
+} ned_t;
+
+typedef struct {
+    uint32_t seq;       // odd while the writer is on this buffer
+    uint32_t epoch_ms;  // itow for NAV-PVT, ms of the UTC day for NMEA
+    uint64_t epoch_us;  // the same epoch in pico time
+    int32_t lat;        // 1e-7 deg
+    int32_t lon;
+    int32_t height;     // mm, held for NMEA without GGA
+    int32_t vel[3];     // north, east, down, mm/s
+    int32_t acc[3];     // mm/s^2, from the velocity change since the previous fix
+    int32_t k_lat;      // 1e-7 deg of latitude per mm north, Q28
+    int32_t k_lon;      // 1e-7 deg of longitude per mm east, Q28
+} dr_anchor_t;
+
+typedef struct {
+    int32_t lat;        // 1e-7 deg
+    int32_t lon;
+    int32_t height;     // above the ellipsoid, mm
+    int32_t age_us;     // since the epoch extrapolated from
+} dr_position_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t sum_h;     // mm
+    uint64_t sum_v;
+    uint32_t max_h;
+    uint32_t max_v;
+} dr_error_t;
+
+typedef struct {
+    char *p;     // next byte of the sentence
+    uint8_t ck;  // XOR of everything after the $ so far
+} nmea_writer_t;
+
+typedef struct {
+    const char *name;
+    uint64_t cycles;  // clk_sys cycles since the last report, interrupts that hit it included
+    uint32_t calls;
+    uint32_t idle;    // cheapest call, ie. the cost of finding nothing to do
+    uint32_t max;
+} task_stats_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;        // 0x00, REGMAP_VERSION
+    uint8_t size;           // 0x01, sizeof(regmap_t)
+    uint16_t seq;           // 0x02, incremented every update
+    uint32_t itow;          // 0x04, ms
+    uint16_t year;          // 0x08, UTC
+    uint8_t month;          // 0x0A
+    uint8_t day;            // 0x0B
+    uint8_t hour;           // 0x0C
+    uint8_t min;            // 0x0D
+    uint8_t sec;            // 0x0E
+    uint8_t valid;          // 0x0F, bit0 date, bit1 time
+    int32_t nano;           // 0x10
+    uint8_t fix_type;       // 0x14
+    uint8_t flags;          // 0x15, bit0 gnssFixOK
+    uint8_t num_sv;         // 0x16
+    uint8_t reserved;       // 0x17
+    int32_t lat;            // 0x18, 1e-7 deg
+    int32_t lon;            // 0x1C, 1e-7 deg
+    int32_t h_msl;          // 0x20, mm
+    uint32_t h_acc;         // 0x24, mm
+    uint32_t v_acc;         // 0x28, mm
+    int32_t vel_n;          // 0x2C, mm/s
+    int32_t vel_e;          // 0x30, mm/s
+    int32_t vel_d;          // 0x34, mm/s
+    int32_t g_speed;        // 0x38, mm/s
+    int32_t head_mot;       // 0x3C, 1e-5 deg
+    uint32_t age_ms;        // 0x40, pico uptime at the update minus fix receipt
+    uint32_t rx_bytes;      // 0x44, link stats from here on
+    uint32_t pvt_count;     // 0x48
+    uint32_t ubx_bad_frames;  // 0x4C
+} regmap_t;
+_Static_assert(sizeof(regmap_t) == 0x50, "regmap_t layout changed, bump REGMAP_VERSION");
+
 void on_uart_rx(void);
 int get_checksum(char *string);
 void uart_tx_setup(void);
 void uart_rx_setup(void);
+void rx_pause(void);
+void rx_resume(void);
+int uart_flow_probe(void);
+int uart_flow_setup(void);
+void uart_flow_off(void);
+int flow_free_slots(void);
+void service_flow(void);
+void compare_flow_modes(int testrun);
+void print_flow_stats(void);
+int configure_ddc_port(uint16_t threshold, int testrun);
+void ddc_setup(void);
+void txready_pin_changed(void);
+int ddc_available(void);
+uint32_t service_ddc(void);
+void compare_txready_thresholds(int testrun);
+void print_ddc_stats(void);
 void compile_message(char *nmea_msg, char *raw_msg, char *checksum,
                      char *terminator);
 int extract_baud_rate(char *string);
@@ -47,33 +674,815 @@ void send_nmea(int testrun, int changing_baud);
 void send_ubx(int testrun);
 void fire_nmea_msg(char *msg);
 void fire_ubx_msg(uint8_t *msg, size_t len);
+uint32_t ubx_u32(const uint8_t *p);
+uint64_t rx_time_us(void);
+int nmea_atoi(const char *s);
+int nmea_strncmp(const char *a, const char *b, size_t n);
+size_t nmea_strlen(const char *s);
+char nmea_upper(char c);
+size_t compile_ubx_msg(uint8_t *ubx_msg, uint8_t msg_class, uint8_t msg_id,
+                       const uint8_t *payload, uint16_t len);
+void send_ubx_frame(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len);
+int ubx_parse_byte(ubx_rx_t *rx, uint8_t ch);
+void handle_ubx_frame(uint8_t msg_class, uint8_t msg_id, uint8_t *payload, uint16_t len);
+int nmea_parse_byte(nmea_rx_t *rx, uint8_t ch);
+void handle_nmea_sentence(char *line, uint16_t len, uint32_t hash);
+nmea_cache_t *nmea_cache_lookup(const char *line, uint8_t part, uint16_t len, uint32_t hash, int *hit);
+int gsv_talker(const char *talker);
+int gsv_part_start(int talker_gnss, int msg_num);
+void gsv_part_end(int talker_gnss, int num_msg, int msg_num);
+void print_nmea_cache_stats(void);
+void replay_gsv_log(void);
+int nmea_split(char *line, char **fields, int max_fields);
+int sat_slot(int talker_gnss, int svid, int *gnss);
+void sat_set(int gnss, int slot, uint8_t cno, int8_t elev, int16_t azim);
+void sat_commit(int gnss, uint64_t seen);
+uint64_t decode_gsv(char **fields, int num_fields);
+void decode_nav_sat(const uint8_t *payload, uint16_t len);
+int sat_snapshot(int gnss, uint8_t *cno, int8_t *elev, int16_t *azim, sat_summary_t *summary);
+void print_sat_stats(void);
+int feed_rx_byte(uint8_t ch);
+int sink_accepts(sink_t *sink, uint8_t type, uint8_t msg_class, uint8_t msg_id);
+void frame_publish(uint8_t type, uint8_t msg_class, uint8_t msg_id, const uint8_t *data, uint16_t len);
+void frame_release(uint8_t idx);
+void service_sinks(void);
+void print_sink_stats(void);
+int ubx_is_streamed(uint8_t msg_class, uint8_t msg_id);
+raw_record_t *raw_claim(ubx_rx_t *rx, uint8_t msg_id, uint8_t len);
+void raw_publish(raw_record_t *rec);
+void raw_stream_byte(ubx_rx_t *rx, uint8_t ch);
+void raw_stream_end(ubx_rx_t *rx, int ok);
+void service_raw_records(void);
+void print_raw_stats(void);
+int cfg_value_size(uint32_t key);
+int wait_for_cfg_ack(uint32_t replies_before, uint8_t msg_class, uint8_t msg_id);
+void cfg_write(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len, int testrun);
+int probe_cfg_backend(void);
+int journal_latest(journal_record_t *rec);
+int journal_slot_erased(int slot);
+void journal_append(journal_record_t *rec);
+uint32_t journal_txn_hash(void);
+int module_responds(int baud);
+int journal_apply(int testrun);
+void cfg_write_raw(const uint8_t *data, size_t len, int testrun);
+int profile_delta(const mission_profile_t *from, const mission_profile_t *to, cfg_item_t *delta);
+uint32_t profile_hash(int backend);
+int prepare_transitions(int testrun);
+int switch_profile(int to, int testrun);
+void demo_profile_switching(int testrun);
+int cfg_apply_valset(const cfg_item_t *items, int num_items, uint8_t layers, int testrun);
+int cfg_verify_valget(const cfg_item_t *items, int num_items);
+int cfg_apply_legacy(const cfg_item_t *items, int num_items, uint8_t layers, int testrun);
+int apply_profile(const cfg_item_t *items, int num_items, uint8_t layers, int testrun);
+void compare_config_backends(int testrun);
+void geofence_prepare(void);
+int configure_geofences(int testrun);
+void gpio_event(uint gpio, uint32_t events);
+void geofence_pin_changed(uint gpio, uint32_t events);
+void request_geofence_state(void);
+int geofence_check_pico(const nav_fix_t *fix);
+void compare_geofence_cost(void);
+void print_geofence_stats(void);
+int apply_power_profile(const pm_profile_t *profile, int testrun);
+int pm_keeps(const pm_profile_t *profile, pm_stats_t *stats, uint32_t itow);
+void pm_add_epoch(pm_stats_t *stats, const nav_fix_t *fix);
+void power_profile_fix(const nav_fix_t *fix);
+void print_pm_stats(const char *name, const pm_stats_t *stats);
+void measure_power_profiles(void);
+uint32_t feed_synthetic_rawx(int num_meas, int corrupt);
+void benchmark_raw_stream(void);
+void print_irq_stats(void);
+void benchmark_hot_paths(void);
+void stack_paint(void);
+uint32_t stack_high_water(const uint32_t *bottom, const uint32_t *top);
+void print_stack_stats(const char *when);
+void tasks_reset(void);
+uint32_t task_done(int task, uint32_t start);
+void print_task_stats(void);
+uint32_t gov_baud_error_ppm(uint32_t clk_hz, uint32_t baud);
+int governor_setup(void);
+void governor_set_step(int step);
+int governor_pressure(void);
+void governor_tick(uint32_t start_cycles, uint64_t start_us);
+void print_governor_stats(void);
+int usb_log_write(const frame_t *frame);
+int mavlink_sink_write(const frame_t *frame);
+int wait_for_mga_ack(uint32_t replies_before, uint32_t timeout_ms);
+void enable_mga_ack(void);
+void save_nav_database(int testrun);
+void restore_nav_database(int testrun);
+void report_ttff(const char *aiding);
+int send_mga_frame(const uint8_t *frame, size_t len, int *acking);
+uint32_t upload_mga_blob(const uint8_t *blob, size_t len);
+void upload_assistnow_flash(int testrun);
+void upload_assistnow_stdin(int testrun);
+void change_baud_rate(int baud);
+void configure_batching(int testrun, uint16_t epochs);
+uint32_t retrieve_batch(void);
+void run_batching_cycle(int testrun, uint16_t epochs);
+void decode_nav_pvt(const uint8_t *payload, nav_fix_t *fix, uint8_t fields);
+void fix_subscribe(uint8_t fields);
+void fix_restore_subscriptions(uint8_t fields);
+int32_t parse_fixed(const char *s, int decimals);
+int32_t parse_nmea_coord(const char *s, char hemisphere);
+void parse_nmea_time(const char *s, nav_fix_t *fix);
+int decode_nmea_fix(char *line, nav_fix_t *fix, uint8_t fields);
+void benchmark_decoders(void);
+void set_nmea_rate(const char *identifier, int rate);
+void set_ubx_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate);
+void set_ubx_port_rates(uint8_t msg_class, uint8_t msg_id, uint8_t ddc_rate, uint8_t uart_rate);
+void set_poll_mode(int testrun, int enable);
+int request_position(fix_callback_t callback);
+void service_position_requests(void);
+void print_fix(const nav_fix_t *fix);
+void compare_poll_vs_stream(int testrun, uint32_t seconds, uint32_t poll_interval_ms);
+uint32_t replay_from_stdin(fix_callback_t on_fix);
+void set_nav_rate(uint16_t period_ms);
+int update_nav_rate(const nav_fix_t *fix, int dry_run);
+void adaptive_rate_fix(const nav_fix_t *fix);
+void simulate_adaptive_rate(void);
+uint16_t crc_x25(const uint8_t *data, size_t len, uint16_t crc);
+uint32_t days_from_civil(int year, int month, int day);
+uint64_t fix_unix_time_us(const nav_fix_t *fix);
+void mavlink_uart_setup(void);
+size_t mavlink_finalize(uint8_t *frame, uint8_t msg_id, size_t len, uint8_t crc_extra);
+uint8_t mavlink_fix_type(const nav_fix_t *fix);
+size_t mavlink_encode_gps_raw_int(uint8_t *frame, const nav_fix_t *fix);
+size_t mavlink_encode_gps_input(uint8_t *frame, const nav_fix_t *fix);
+int mavlink_send_fix(const nav_fix_t *fix, int msg);
+void print_mavlink_stats(void);
+void regmap_update(const nav_fix_t *fix);
+void regmap_i2c_handler(i2c_inst_t *i2c, i2c_slave_event_t event);
+void regmap_setup(void);
+size_t regmap_emulate_read(uint8_t reg, uint8_t *buf, size_t len);
+void print_regmap_stats(void);
+void lla_to_ecef(double lat, double lon, double h, double *ecef);
+void ned_set_home(ned_home_t *home, int32_t lat, int32_t lon, int32_t height);
+void ned_from_lla(const ned_home_t *home, int32_t lat, int32_t lon, int32_t height, ned_t *ned);
+void ned_from_ecef(const ned_home_t *home, const int32_t *ecef_cm, ned_t *ned);
+void ned_reference(const ned_home_t *home, const double *ecef, double *ned);
+void validate_ned(void);
+void print_ned_stats(void);
+int32_t isin_q30(uint32_t angle);
+void dr_update(const nav_fix_t *fix, uint32_t epoch_ms, uint32_t wrap_ms, uint32_t frame_bytes);
+void dr_extrapolate(const dr_anchor_t *a, int64_t dt_us, int order, dr_position_t *out);
+int dr_predict(uint64_t t_us, dr_position_t *out);
+void dr_update_pvt(const nav_fix_t *fix);
+void dr_update_nmea(nav_fix_t *fix);
+void measure_dr_replay(void);
+void print_dr_stats(void);
+void nmea_put(nmea_writer_t *w, char c);
+void nmea_put_str(nmea_writer_t *w, const char *s);
+void nmea_put_uint(nmea_writer_t *w, uint32_t v, int min_digits);
+void nmea_put_fixed(nmea_writer_t *w, int32_t v, int decimals);
+void nmea_begin(nmea_writer_t *w, char *buf, const char *type);
+size_t nmea_end(nmea_writer_t *w, char *buf);
+void nmea_put_time(nmea_writer_t *w, const nav_fix_t *fix);
+void nmea_put_coord(nmea_writer_t *w, int32_t v, int deg_digits, char pos, char neg);
+uint8_t nmea_quality(const nav_fix_t *fix);
+size_t nmea_format_gga(char *buf, const nav_fix_t *fix);
+size_t nmea_format_rmc(char *buf, const nav_fix_t *fix);
+size_t nmea_format_zda(char *buf, const nav_fix_t *fix);
+int nmea_output_fix(const nav_fix_t *fix);
+void print_nmea_output_stats(void);
+void benchmark_nmea_output(void);
+
+static ubx_rx_t ubx_rx;  // only touched from the RX interrupt, or with it paused
+static nmea_rx_t nmea_rx;
+static int rx_enabled = 0;
+static nav_fix_t rx_paused_fix;  // the live fix, kept aside while a replay or benchmark owns the parser
+static uint8_t nav_db[NAV_DB_FLASH_SIZE];  // flash image: header followed by raw MGA-DBD frames
+static volatile uint32_t nav_db_len = sizeof(nav_db_header_t);
+static volatile uint32_t nav_db_msgs = 0;
+static volatile uint64_t nav_db_last_rx_us = 0;
+static volatile uint32_t mga_acks = 0;   // MGA-ACK-DATA0 with type 1 (accepted)
+static volatile uint32_t mga_nacks = 0;  // MGA-ACK-DATA0 with type 0 (not used)
+static volatile uint8_t nav_fix_ok = 0;
+static volatile uint8_t nav_fix_type = 0;
+static volatile uint32_t nav_ttff_ms = 0;
+static int current_baud = BAUD_RATE;  // baud the module and the pico are talking at
+static nav_fix_t batch_fixes[BATCH_MAX_EPOCHS];
+static volatile uint32_t batch_count = 0;
+static volatile uint32_t batch_bytes = 0;
+static volatile uint64_t batch_last_rx_us = 0;
+static volatile int32_t batch_fill_level = -1;  // from MON-BATCH, -1 until it arrives
+static volatile uint32_t rx_bytes = 0;  // everything read off the UART
+static volatile uint64_t rx_irq_us = 0;  // time spent in on_uart_rx()
+static nav_fix_t last_fix;  // latest NAV-PVT, written from the RX interrupt
+static volatile uint32_t pvt_count = 0;
+static volatile uint8_t fix_field_mask = 0;  // union of all subscriptions
+static nav_fix_t nmea_fix;  // latest fields decoded from GGA, RMC and ZDA
+static volatile uint32_t nmea_fix_count = 0;
+static fix_callback_t fix_waiters[MAX_FIX_WAITERS];
+static int num_fix_waiters = 0;
+static uint32_t pvt_poll_count = 0;  // pvt_count when the outstanding poll was sent
+static uint64_t pvt_poll_sent_us = 0;
+static uint16_t nav_period_ms = NAV_PERIOD_MS;  // current CFG-RATE measurement period
+static const uint16_t rate_periods_ms[RATE_STEPS] = { 1000, 500, 200, 100 };
+static const int32_t rate_up_speed[RATE_STEPS] = { 2000, 6000, 12000, INT32_MAX };  // mm/s
+static const int32_t rate_down_speed[RATE_STEPS] = { 0, 1000, 4000, 9000 };  // mm/s
+static int rate_step = 0;
+static uint32_t rate_changed_itow = 0;
+static uint32_t rate_changes = 0;
+static uint32_t sim_epochs = 0;  // epochs the module would have output at the adapted rate
+static uint32_t sim_log_epochs = 0;
+static uint32_t sim_last_itow = 0;
+
+// CRC-16/X.25 (MCRF4XX) as used by MAVLink, reflected polynomial 0x8408
+static const uint16_t HOT_DATA crc_x25_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+    0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+    0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+    0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+    0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+    0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+    0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+    0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+    0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+    0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+    0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+    0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+    0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+    0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+    0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+    0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+    0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+    0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+    0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+    0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+    0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+    0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+    0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+    0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+    0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+    0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+    0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+    0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+    0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+    0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+    0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+    0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
+};
+static uint8_t mavlink_buf[2][MAVLINK_MAX_FRAME];  // one being sent by DMA, one being filled
+static int mavlink_buf_idx = 0;
+static int mavlink_dma_chan = -1;
+static uint8_t mavlink_seq = 0;
+static uint32_t mavlink_sent = 0;
+static int mavlink_msg = 0;  // MAVLink message the sink sends, see mavlink_output
+static uint64_t mavlink_encode_us = 0;
+static uint32_t mavlink_encode_max_us = 0;
+static uint64_t mavlink_latency_us = 0;  // NAV-PVT received to last byte on the wire
+static raw_record_t raw_ring[RAW_RING_LEN];
+static volatile uint16_t raw_head = 0;  // only written by the RX interrupt
+static volatile uint16_t raw_tail = 0;  // only written by the main loop
+static uint32_t raw_frames = 0;
+static uint32_t raw_frames_bad = 0;
+static uint32_t raw_dropped = 0;    // ring full, the main loop fell behind
+static uint32_t raw_bytes = 0;      // payload bytes streamed
+static uint16_t raw_largest = 0;    // largest payload streamed, what a buffer would have needed
+static uint16_t raw_ring_peak = 0;  // most records in the ring at once
+static uint16_t raw_epoch_frame[RAW_SOURCES];    // main loop: frame the unconfirmed records belong to
+static uint16_t raw_epoch_records[RAW_SOURCES];  // main loop: records taken from it so far
+static uint8_t raw_epoch_id[RAW_SOURCES];        // main loop: and its message id
+static uint32_t raw_records = 0;    // confirmed by their frame's checksum
+static uint32_t raw_retracted = 0;  // taken, then thrown away: bad checksum or lost verdict
+static uint32_t raw_meas = 0;       // confirmed RAWX measurements
+static uint32_t raw_subframes = 0;  // confirmed SFRBX subframes
+static const cfg_item_t cfg_profile[] = {  // what send_nmea() sets up, as key-value items
+    { 0x209100BB, 1, CFG_LEGACY_NMEA, "GGA", 0, 0 },  // CFG-MSGOUT-NMEA_ID_GGA_UART1
+    { 0x209100D9, 1, CFG_LEGACY_NMEA, "ZDA", 0, 0 },
+    { 0x209100C0, 0, CFG_LEGACY_NMEA, "GSA", 0, 0 },
+    { 0x209100AC, 0, CFG_LEGACY_NMEA, "RMC", 0, 0 },
+    { 0x209100C5, 0, CFG_LEGACY_NMEA, "GSV", 0, 0 },
+    { 0x209100B1, 0, CFG_LEGACY_NMEA, "VTG", 0, 0 },
+    { 0x209100CA, 0, CFG_LEGACY_NMEA, "GLL", 0, 0 },
+    { 0x20910007, 0, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_PVT },  // CFG-MSGOUT-UBX_NAV_PVT_UART1
+    { 0x2091001B, 0, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_STATUS },
+    { 0x30210001, NAV_PERIOD_MS, CFG_LEGACY_RATE, NULL, 0, 0 },  // CFG-RATE-MEAS
+};
+static const pm_profile_t pm_profiles[] = {
+    { "continuous", 0, PM2_CYCLIC, 1000, 10000, 0 },
+    { "cyclic tracking 1 s", 1, PM2_CYCLIC, 1000, 10000, 0 },
+    { "cyclic tracking 5 s", 1, PM2_CYCLIC, 5000, 10000, 0 },
+    { "on/off 30 s, 5 s on", 1, PM2_ONOFF, 30000, 60000, 5 },
+    { "on/off 120 s, 10 s on", 1, PM2_ONOFF, 120000, 60000, 10 },
+};
+#define PM_PROFILES (sizeof(pm_profiles) / sizeof(pm_profiles[0]))
+static pm_stats_t pm_stats[PM_PROFILES];  // simulated from a continuous log
+static pm_stats_t pm_recorded;  // the log as it was recorded
+static const geofence_t geofences[] = {  // change as needed
+    { 472852331, 85652650, 5000 },  // 50 m around the home point
+    { 472900000, 85700000, 200000 },  // 2 km flying field
+};
+#define NUM_GEOFENCES (sizeof(geofences) / sizeof(geofences[0]))
+static int32_t geofence_lon_q16[GEOFENCE_MAX];  // cos(lat) of each fence, longitude scale for the pico check
+static int64_t geofence_r2[GEOFENCE_MAX];  // radius squared in (1e-7 deg)^2
+static volatile uint32_t geofence_edges = 0;  // pin changes
+static uint32_t geofence_edges_seen = 0;
+static volatile uint32_t geofence_replies = 0;  // NAV-GEOFENCE received
+static volatile uint8_t geofence_status = 0;  // 0 not available, 1 active
+static volatile uint8_t geofence_comb_state = 0;  // 0 unknown, 1 inside, 2 outside
+static volatile uint8_t geofence_states[GEOFENCE_MAX];
+static uint32_t geofence_link_bytes = 0;  // polls and replies
+static const cfg_item_t cruise_items[] = {
+    { 0x20910007, 1, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_PVT },
+    { 0x30210001, 200, CFG_LEGACY_RATE, NULL, 0, 0 },
+    { 0x209100BB, 1, CFG_LEGACY_NMEA, "GGA", 0, 0 },
+    { 0x209100C5, 0, CFG_LEGACY_NMEA, "GSV", 0, 0 },
+    { 0x20910016, 0, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_SAT },
+};
+static const cfg_item_t landing_items[] = {  // fastest rate, nothing but the fix on the link
+    { 0x20910007, 1, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_PVT },
+    { 0x30210001, 100, CFG_LEGACY_RATE, NULL, 0, 0 },
+    { 0x209100BB, 0, CFG_LEGACY_NMEA, "GGA", 0, 0 },
+    { 0x209100C5, 0, CFG_LEGACY_NMEA, "GSV", 0, 0 },
+    { 0x20910016, 0, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_SAT },
+};
+static const cfg_item_t loiter_items[] = {  // slow, with the satellites for the ground station
+    { 0x20910007, 1, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_PVT },
+    { 0x30210001, 1000, CFG_LEGACY_RATE, NULL, 0, 0 },
+    { 0x209100BB, 1, CFG_LEGACY_NMEA, "GGA", 0, 0 },
+    { 0x209100C5, 1, CFG_LEGACY_NMEA, "GSV", 0, 0 },
+    { 0x20910016, 1, CFG_LEGACY_MSG, NULL, UBX_CLASS_NAV, UBX_NAV_SAT },
+};
+static const mission_profile_t mission_profiles[] = {
+    { "cruise", cruise_items, sizeof(cruise_items) / sizeof(cruise_items[0]) },
+    { "precision landing", landing_items, sizeof(landing_items) / sizeof(landing_items[0]) },
+    { "low-power loiter", loiter_items, sizeof(loiter_items) / sizeof(loiter_items[0]) },
+};
+#define NUM_MISSION_PROFILES (int)(sizeof(mission_profiles) / sizeof(mission_profiles[0]))
+static int current_profile = -1;  // index into mission_profiles, -1 until the first switch
+static uint8_t *cfg_capture = NULL;  // when set, the backends append their frames here instead of sending
+static uint32_t cfg_capture_len = 0;
+static uint32_t cfg_capture_acks = 0;
+static int cfg_backend = CFG_BACKEND_UNKNOWN;  // set by probe_cfg_backend()
+static volatile uint32_t cfg_acks = 0;  // ACK-ACK and ACK-NAK, for any message
+static volatile uint8_t cfg_ack_class = 0;
+static volatile uint8_t cfg_ack_id = 0;
+static volatile uint8_t cfg_ack_ok = 0;
+static uint8_t cfg_payload[4 + CFG_VALSET_MAX_ITEMS * 8];  // VALSET being built, or the last VALGET reply
+static volatile uint16_t valget_len = 0;
+static volatile uint32_t valget_count = 0;
+static uint32_t cfg_messages = 0;  // sent by the backends
+static uint32_t cfg_bytes = 0;
+static const char HOT_DATA hex_digits[] = "0123456789ABCDEF";
+static volatile uint32_t irq_count = 0;  // on_uart_rx() calls, and their cost in clk_sys cycles
+static volatile uint32_t irq_bytes = 0;
+static volatile uint64_t irq_cycles = 0;
+static volatile uint32_t irq_cycles_max = 0;
+static volatile uint32_t irq_byte_cycles_min = UINT32_MAX;  // per byte, within one call
+static volatile uint32_t irq_byte_cycles_max = 0;
+static const uint32_t gov_khz[] = { 48000, 64000, 96000, 125000, 133000 };  // each one exact from the 12 MHz crystal
+#define GOV_STEPS (int)(sizeof(gov_khz) / sizeof(gov_khz[0]))
+static uint32_t gov_vco[GOV_STEPS];  // PLL settings, 0 for steps that are out of bounds
+static uint32_t gov_postdiv1[GOV_STEPS];
+static uint32_t gov_postdiv2[GOV_STEPS];
+static uint64_t gov_step_us[GOV_STEPS];  // time spent at each step
+static int gov_step = -1;  // -1 while the governor is off
+static uint64_t gov_step_start_us = 0;
+static uint64_t gov_window_start_us = 0;
+static uint64_t gov_cycles = 0;  // main loop cycles in the window
+static uint32_t gov_passes = 0;
+static uint32_t gov_idle_cycles = UINT32_MAX;  // cheapest pass in the window, ie. one that found nothing to do
+static int gov_pressure_peak = 0;  // %, in the window
+static int gov_quiet_windows = 0;
+static int gov_load = 0;  // %, of the last window
+static int gov_load_max = 0;
+static uint32_t gov_changes = 0;
+static int flow_lines = 0;  // FLOW_CTS | FLOW_RTS in use, 0 for none
+static volatile int flow_held = 0;  // RTS dropped for the pool watermark
+static volatile uint32_t flow_holds = 0;
+static volatile uint32_t rx_overruns = 0;  // PL011 overrun errors, bytes were lost
+static ubx_rx_t ddc_ubx_rx;  // frames arriving over DDC are framed separately from the UART
+static nmea_rx_t ddc_nmea_rx;
+static uint16_t ddc_threshold = 0;  // bytes txReady is configured for, 0 if polling
+static uint16_t ddc_burst = DDC_BURST_MIN;  // bytes per read transaction
+static volatile uint32_t txready_edges = 0;
+static uint32_t txready_edges_seen = 0;
+static uint64_t ddc_next_poll_us = 0;
+static uint64_t ddc_bus_us = 0;  // time the bus was busy with our transactions
+static uint32_t ddc_transactions = 0;
+static uint32_t ddc_empty = 0;  // reads of the pending count that found nothing
+static uint32_t ddc_bytes = 0;
+static uint32_t ddc_pvt_count = 0;  // NAV-PVT that came in over DDC
+static int64_t ddc_pvt_offset_us = 0;  // arrival of the latest one, less its iTOW
+extern uint32_t __StackBottom[], __StackTop[];  // from the SDK's linker script
+extern uint32_t __StackOneBottom[], __StackOneTop[];
+enum { TASK_POSITION, TASK_SINKS, TASK_LINKS, TASK_RAW, TASK_GEOFENCE, TASK_FIX, TASK_STATS, TASK_GOVERNOR, NUM_TASKS };
+static task_stats_t tasks[NUM_TASKS] = {
+    [TASK_POSITION] = { .name = "position" },
+    [TASK_SINKS] = { .name = "sinks" },
+    [TASK_LINKS] = { .name = "flow/ddc" },
+    [TASK_RAW] = { .name = "raw" },
+    [TASK_GEOFENCE] = { .name = "geofence" },
+    [TASK_FIX] = { .name = "fix consumers" },
+    [TASK_STATS] = { .name = "stats" },
+    [TASK_GOVERNOR] = { .name = "governor" },
+};
+static uint64_t tasks_since_us = 0;
+static const char HOT_DATA digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+static int nmea_out_dest = 0;  // 1 uart0, 2 USB
+static char nmea_out_buf[2][NMEA_OUT_MAX];  // one being sent by DMA, one being filled
+static int nmea_out_idx = 0;
+static uint32_t nmea_out_epochs = 0;
+static uint32_t nmea_out_dropped = 0;  // epochs skipped, the previous one was still going out
+static uint64_t nmea_out_format_us = 0;
+static int32_t last_ecef[3];  // latest NAV-POSECEF, cm, written from the RX interrupt
+static volatile uint32_t posecef_count = 0;
+static ned_home_t ned_home;
+static int ned_home_set = 0;
+static ned_t last_ned;
+static uint32_t ned_count = 0;
+static uint64_t ned_cycles = 0;
+static dr_anchor_t dr_anchors[2];  // double buffered: readers take the active one, the writer fills the other
+static volatile int dr_active = -1;  // -1 until the first fix
+static int64_t dr_offset_us = 0;  // pico time minus epoch time, the smallest seen, creeping up with clock drift
+static int dr_synced = 0;
+static uint32_t dr_updates = 0;
+static dr_error_t dr_errors[3];  // against the next fix: holding the last fix, velocity, velocity and acceleration
+static uint64_t dr_gap_ms = 0;  // summed over the measured fixes
+static volatile uint32_t ubx_bad_frames = 0;  // UBX frames dropped for a bad checksum
+static regmap_t regmap[2];  // double buffered: the host reads one while the other is updated
+static volatile int regmap_active = 0;  // the buffer new read transactions start on
+static volatile int regmap_reading = -1;  // buffer latched by the transaction in progress
+static uint8_t regmap_reg = 0;  // offset of the next byte the host reads
+static int regmap_addressed = 0;  // the first byte written in a transaction is the offset
+static uint32_t regmap_skipped = 0;  // updates skipped because the host was reading the target
+static volatile uint32_t nmea_bad_sentences = 0;  // dropped for a bad or missing checksum
+// satellite table, structure of arrays. written from the RX interrupt; readers
+// go through sat_snapshot(), which retries while sat_seq is odd or changes.
+static uint8_t sat_cno[SAT_GNSS][SAT_SLOTS];   // dBHz, 0 if not tracked
+static int8_t sat_elev[SAT_GNSS][SAT_SLOTS];   // deg
+static int16_t sat_azim[SAT_GNSS][SAT_SLOTS];  // deg
+static uint64_t sat_present[SAT_GNSS];  // bitmap of slots in the last complete group
+static sat_summary_t sat_summary[SAT_GNSS];
+static volatile uint32_t sat_seq[SAT_GNSS];
+static sat_change_t sat_pending[SAT_PENDING_MAX];  // changes of the GSV group in progress
+static int sat_pending_count = 0;
+static int sat_group_gnss = -1;  // constellation of the GSV group in progress, -1 if none
+static int sat_group_next = 0;  // GSV part number expected next
+static uint64_t sat_group_seen = 0;
+static uint32_t sat_group_id = 0;  // incremented at the start of every GSV group
+static nmea_cache_t nmea_cache[NMEA_CACHE_SLOTS];
+static int nmea_cache_next = 0;  // slot replaced on the next miss
+static uint32_t nmea_cache_lookups = 0;
+static uint32_t nmea_cache_hits = 0;
+static uint32_t gsv_decoded = 0;  // GSV parts parsed, and the time it took
+static uint64_t gsv_decode_us = 0;
+static uint32_t gsv_reused = 0;   // GSV parts taken from the cache, and the time that took
+static uint64_t gsv_reuse_us = 0;
+static uint32_t sat_updates = 0;  // satellites actually changed, ie. the work done
+static uint32_t sat_reported = 0;  // satellites reported by GSV / NAV-SAT
+static const char *sat_gnss_names[SAT_GNSS] = { "GPS", "SBAS", "Galileo", "BeiDou", "IMES", "QZSS", "GLONASS" };
+static frame_t frame_pool[FRAME_POOL_SIZE];
+static uint8_t frame_free[FRAME_POOL_SIZE];  // stack of free pool indices
+static int frame_free_count = 0;
+static int frame_free_min = FRAME_POOL_SIZE;  // low watermark, pool pressure
+static uint32_t frame_pool_exhausted = 0;
+enum { SINK_USB_LOG, SINK_MAVLINK, NUM_SINKS };  // a flash logger or shell would add an entry here
+static sink_t sinks[NUM_SINKS] = {
+    [SINK_USB_LOG] = { .name = "usb log", .enabled = 1, .nmea = 1, .ubx_class = FILTER_NONE,
+                       .decimate = 1, .write = usb_log_write },
+    [SINK_MAVLINK] = { .name = "mavlink", .enabled = 0, .nmea = 0, .ubx_class = UBX_CLASS_NAV,
+                       .ubx_id = UBX_NAV_PVT, .decimate = 1, .write = mavlink_sink_write },
+};
 
 
 int main(void) {
+    stack_paint();  // before anything deeper than main() has run
     stdio_init_all();  // important so that printf() works
+    for (int i = 0; i < FRAME_POOL_SIZE; i++)  // every frame buffer starts out free
+        frame_free[frame_free_count++] = i;
+    systick_hw->rvr = 0x00FFFFFF;  // free running cycle counter for the interrupt timing
+    systick_hw->csr = 0x05;  // enabled, clk_sys, no interrupt
     uart_init(UART_ID, BAUD_RATE);
     uart_tx_setup();  // initialize UART Tx on the pico
 
     //  execution parameters ----------------------------------
     int testrun = 0;  // 1 to print the simulated transmission only, 0 to transmit it.
     int changing_baud = 0;  // only required for NMEA messages
+    int save_nav_db = 0;  // 1 to cache the module's navigation database in the pico's flash, it erases up to 32 KB each time
+    int restore_nav_db = 0;  // 1 to stream the navigation database cached in the pico's flash back to the module
+    int upload_assistnow = 0;  // 1 to upload AssistNow data from the pico's flash, 2 from a file piped over USB
+    int batch_epochs = 0;  // >0 to let the module batch this many fixes while the pico sleeps, then retrieve them
+    int poll_interval_ms = 0;  // >0 to turn off periodic output and poll NAV-PVT this often instead
+    int compare_poll = 0;  // >0 to compare the link and CPU use of polling at poll_interval_ms and streaming, this many seconds each
+    int adaptive_rate = 0;  // 1 to adapt the nav rate to the ground speed, 2 to simulate it on a log replayed over USB
+    int mavlink_output = 0;  // 1 to send each fix to a flight controller as MAVLink GPS_RAW_INT, 2 as GPS_INPUT
+    int benchmark = 0;  // 1 to time the decoders under typical subscription sets
+    int sat_table = 0;  // 1 to keep a satellite table from GSV, 2 from NAV-SAT, 3 to replay a GSV log over USB
+    int regmap_output = 0;  // 1 to serve the latest fix as an I2C slave register map
+    int raw_measurements = 0;  // 1 to stream RXM-RAWX and RXM-SFRBX, raw measurement firmware only
+    int config_profile = 0;  // 1 to apply cfg_profile with whichever backend the module supports, 2 to compare the backends
+    int power_profile = 0;  // >0 to put the module in power save with pm_profiles[power_profile - 1]
+    int measure_power = 0;  // 1 to compare the power profiles on a log replayed over USB
+    int geofence = 0;  // 1 to have the module check `geofences` and wake the pico on changes, 2 to compare with checking on the pico
+    int mission_switching = 0;  // 1 to build the profile transitions in flash and time switching through them
+    int journal_config = 0;  // 1 to apply cfg_profile and JOURNAL_TARGET_BAUD through the flash journal, resuming after a power loss
+    int clock_governor = 0;  // 1 to scale sys_clk with the main loop load and the RX backlog
+    int uart_flow = 0;  // 1 for the FIFO and RTS/CTS where the wiring has them, 2 to compare with the unflowed mode first
+    int ddc_input = 0;  // 1 to read NAV-PVT over DDC when txReady says so, 2 to compare txReady thresholds first
+    int nmea_output = 0;  // 1 to re-emit GGA, RMC and ZDA from each NAV-PVT on uart0 in place of MAVLink, 2 over USB
+    int local_ned = 0;  // 1 to convert each fix to NED around the first one, 2 each NAV-POSECEF
+    int dead_reckoning = 0;  // 1 to extrapolate between NAV-PVT fixes, 2 between RMC/GGA, 3 to measure it on a log replayed over USB
+    int loop_stats = 0;  // 1 to print the task, stack, sink and RX interrupt stats every STATS_INTERVAL_MS
+    int measure_ttff = 0;  // 1 to report the time to first fix, eg. to compare runs with and without a restore
+
+    if (restore_nav_db)
+        restore_nav_database(testrun);  // do this first, the module is cold and waiting for ephemeris
+    if (upload_assistnow == 1)
+        upload_assistnow_flash(testrun);
+    else if (upload_assistnow == 2)
+        upload_assistnow_stdin(testrun);
+
+    if (batch_epochs > 0)
+        run_batching_cycle(testrun, batch_epochs);
 
     // send nmea, ubx, or both. simply uncomment what you want to send:
     // send_nmea(testrun, changing_baud);  // make changes to desired sentences and/or baud rate
     send_ubx(testrun);   // save the configurations to non-volatile mem on the chip.
     // ---------------------------------- execution parameters
 
+    // decoders only fill in the fields somebody subscribed to
+    if (poll_interval_ms > 0)
+        fix_subscribe(FIX_QUALITY | FIX_POSITION | FIX_ALTITUDE | FIX_VELOCITY);  // print_fix()
+    if (adaptive_rate)
+        fix_subscribe(FIX_TIME | FIX_QUALITY | FIX_VELOCITY | FIX_ACCURACY);
+    if (regmap_output)
+        fix_subscribe(FIX_ALL);
+    if (nmea_output)
+        fix_subscribe(FIX_ALL);
+    if (local_ned)
+        fix_subscribe(FIX_QUALITY | FIX_POSITION | FIX_ALTITUDE);
+    if (dead_reckoning)
+        fix_subscribe(FIX_TIME | FIX_QUALITY | FIX_POSITION | FIX_ALTITUDE | FIX_VELOCITY);
+    if (ddc_input)
+        fix_subscribe(FIX_TIME);  // service_ddc() times NAV-PVT against its iTOW
+    if (benchmark) {
+        rx_pause();  // they feed the UART parser, which may be live after eg. a restore
+        stack_paint();  // each benchmark gets its own high water mark
+        benchmark_decoders();
+        print_stack_stats("decoders");
+        stack_paint();
+        benchmark_raw_stream();
+        print_stack_stats("raw stream");
+        stack_paint();
+        benchmark_hot_paths();
+        print_stack_stats("hot paths");
+        stack_paint();
+        benchmark_nmea_output();
+        print_stack_stats("nmea output");
+        stack_paint();
+        validate_ned();
+        print_stack_stats("ned");
+        rx_resume();
+    }
+    if (sat_table == 3)
+        replay_gsv_log();  // before the RX interrupt is set up
+    if (measure_power)
+        measure_power_profiles();
+    if (adaptive_rate == 2)
+        simulate_adaptive_rate();  // before the RX interrupt is set up
+    if (dead_reckoning == 3)
+        measure_dr_replay();
+    if (geofence == 2)
+        compare_geofence_cost();
+
     uart_rx_setup();  // initialize UART Rx on the pico
-    while (1)
+    if (save_nav_db)
+        save_nav_database(testrun);  // cache ephemeris and almanac before the module loses them
+    if (uart_flow == 2)
+        compare_flow_modes(testrun);
+    else if (uart_flow == 1)
+        uart_flow_setup();  // probes with a CFG-RATE poll, needs the RX interrupt
+    if (power_profile > 0 && power_profile <= (int)PM_PROFILES)
+        apply_power_profile(&pm_profiles[power_profile - 1], testrun);
+    if (geofence == 1)
+        configure_geofences(testrun);
+    if (journal_config)
+        journal_apply(testrun);
+    if (mission_switching)
+        demo_profile_switching(testrun);
+    if (config_profile == 1)
+        apply_profile(cfg_profile, sizeof(cfg_profile) / sizeof(cfg_profile[0]), CFG_LAYER_RAM | CFG_LAYER_BBR, testrun);
+    else if (config_profile == 2)
+        compare_config_backends(testrun);
+    if (measure_ttff)
+        report_ttff(restore_nav_db ? "nav database restore" : upload_assistnow ? "AssistNow" : "no aiding");
+    if (compare_poll > 0)
+        compare_poll_vs_stream(testrun, compare_poll, poll_interval_ms);
+    if (poll_interval_ms > 0)
+        set_poll_mode(testrun, 1);
+    if (adaptive_rate == 1 && !testrun) {
+        set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 1);  // the controller runs on NAV-PVT
+        set_nav_rate(rate_periods_ms[rate_step]);
+    }
+    if (mavlink_output) {
+        mavlink_uart_setup();
+        mavlink_msg = mavlink_output;
+        sinks[SINK_MAVLINK].enabled = 1;
+    }
+    if (regmap_output)
+        regmap_setup();
+    if (nmea_output) {
+        if (!testrun)
+            set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 1);  // the sentences are made from NAV-PVT
+        nmea_out_dest = mavlink_output ? 2 : nmea_output;  // uart0 is taken by MAVLink
+        if (nmea_out_dest == 1)
+            mavlink_uart_setup();
+        else
+            sinks[SINK_USB_LOG].nmea = 0;  // only the re-synthesized stream on USB
+    }
+    if (sat_table == 1 && !testrun)
+        set_nmea_rate("GSV", 1);
+    else if (sat_table == 2 && !testrun)
+        set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_SAT, 1);
+    if (local_ned && !testrun)
+        set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 1);  // home comes from NAV-PVT in both modes
+    if (dead_reckoning == 1 && !testrun) {
+        set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 1);
+    } else if (dead_reckoning == 2 && !testrun) {
+        set_nmea_rate("RMC", 1);  // course and speed
+        set_nmea_rate("GGA", 1);  // height
+    }
+    if (local_ned == 2 && !testrun)
+        set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_POSECEF, 1);
+    if (ddc_input) {
+        // after everything that turns NAV-PVT on, it is moved to DDC so each epoch
+        // reaches the consumers once
+        ddc_setup();
+        if (ddc_input == 2)
+            compare_txready_thresholds(testrun);
+        else
+            configure_ddc_port(TXREADY_THRESHOLD, testrun);
+        if (!testrun)
+            set_ubx_port_rates(UBX_CLASS_NAV, UBX_NAV_PVT, 1, 0);
+    }
+    if (clock_governor)
+        governor_setup();  // after the UARTs and I2C are set up, it re-derives their dividers
+    uint32_t last_posecef = posecef_count;
+    if (raw_measurements && !testrun) {
+        // several KB/s with all constellations, change_baud_rate(921600) first
+        set_ubx_rate(UBX_CLASS_RXM, UBX_RXM_RAWX, 1);
+        set_ubx_rate(UBX_CLASS_RXM, UBX_RXM_SFRBX, 1);
+    }
+    uint32_t last_pvt = pvt_count;
+    uint32_t last_nmea_fix = nmea_fix_count;
+    uint64_t next_stats_us = time_us_64() + STATS_INTERVAL_MS * 1000ULL;
+    uint64_t next_poll_us = time_us_64();
+    tasks_reset();
+    while (1) {
+        uint64_t loop_start_us = time_us_64();
+        uint32_t loop_start_cycles = systick_hw->cvr;
+        uint32_t t = loop_start_cycles;
+        if (poll_interval_ms > 0 && time_us_64() >= next_poll_us) {
+            request_position(print_fix);
+            next_poll_us += poll_interval_ms * 1000ULL;
+        }
+        service_position_requests();
+        t = task_done(TASK_POSITION, t);
+        service_sinks();
+        t = task_done(TASK_SINKS, t);
+        if (uart_flow)
+            service_flow();
+        if (ddc_input)
+            service_ddc();
+        t = task_done(TASK_LINKS, t);
+        if (raw_measurements)
+            service_raw_records();
+        t = task_done(TASK_RAW, t);
+        if (geofence == 1 && geofence_edges != geofence_edges_seen) {
+            geofence_edges_seen = geofence_edges;
+            request_geofence_state();  // the pin says something changed, ask what
+        }
+        t = task_done(TASK_GEOFENCE, t);
+        if (pvt_count != last_pvt) {
+            last_pvt = pvt_count;
+            uint32_t ints = save_and_disable_interrupts();
+            nav_fix_t fix = last_fix;  // consistent copy, the RX interrupt may overwrite it
+            restore_interrupts(ints);
+            if (adaptive_rate == 1)
+                update_nav_rate(&fix, testrun);
+            if (regmap_output)
+                regmap_update(&fix);
+            if (nmea_output)
+                nmea_output_fix(&fix);
+            if (local_ned && !ned_home_set && (fix.fix_type == 3 || fix.fix_type == 4) && (fix.flags & 0x01)) {
+                ned_set_home(&ned_home, fix.lat, fix.lon, fix.height);  // the first 3D fix is home
+                ned_home_set = 1;
+            }
+            if (local_ned == 1 && ned_home_set && (fix.flags & 0x01)) {
+                uint32_t start = systick_hw->cvr;
+                ned_from_lla(&ned_home, fix.lat, fix.lon, fix.height, &last_ned);
+                ned_cycles += (start - systick_hw->cvr) & 0x00FFFFFF;
+                ned_count++;
+            }
+            if (dead_reckoning == 1)
+                dr_update_pvt(&fix);
+        }
+        if (dead_reckoning == 2 && nmea_fix_count != last_nmea_fix) {
+            last_nmea_fix = nmea_fix_count;
+            uint32_t ints = save_and_disable_interrupts();
+            nav_fix_t fix = nmea_fix;
+            restore_interrupts(ints);
+            dr_update_nmea(&fix);
+        }
+        if (local_ned == 2 && ned_home_set && posecef_count != last_posecef) {
+            last_posecef = posecef_count;
+            int32_t ecef[3];
+            uint32_t ints = save_and_disable_interrupts();
+            memcpy(ecef, last_ecef, sizeof(ecef));
+            restore_interrupts(ints);
+            uint32_t start = systick_hw->cvr;
+            ned_from_ecef(&ned_home, ecef, &last_ned);
+            ned_cycles += (start - systick_hw->cvr) & 0x00FFFFFF;
+            ned_count++;
+        }
+        t = task_done(TASK_FIX, t);
+        if (time_us_64() >= next_stats_us) {
+            // printing can take longer than SysTick's 24 bits, so this one is timed in us
+            uint64_t stats_start_us = time_us_64();
+            next_stats_us += STATS_INTERVAL_MS * 1000ULL;
+            if (loop_stats) {
+                print_task_stats();
+                print_stack_stats(NULL);
+                print_sink_stats();
+                print_irq_stats();
+            }
+            if (mavlink_output)
+                print_mavlink_stats();
+            if (sat_table) {
+                print_sat_stats();
+                print_nmea_cache_stats();
+            }
+            if (regmap_output)
+                print_regmap_stats();
+            if (raw_measurements)
+                print_raw_stats();
+            if (geofence == 1)
+                print_geofence_stats();
+            if (clock_governor)
+                print_governor_stats();
+            if (uart_flow)
+                print_flow_stats();
+            if (ddc_input)
+                print_ddc_stats();
+            if (nmea_output)
+                print_nmea_output_stats();
+            if (local_ned)
+                print_ned_stats();
+            if (dead_reckoning)
+                print_dr_stats();
+            uint32_t stats_cycles = (time_us_64() - stats_start_us) * (clock_get_hz(clk_sys) / 1000000);
+            tasks[TASK_STATS].cycles += stats_cycles;
+            tasks[TASK_STATS].calls++;
+            if (stats_cycles > tasks[TASK_STATS].max)
+                tasks[TASK_STATS].max = stats_cycles;
+            t = systick_hw->cvr;
+        }
+        if (clock_governor)
+            governor_tick(loop_start_cycles, loop_start_us);
+        task_done(TASK_GOVERNOR, t);
         tight_loop_contents();
+    }
 }
 
 
-void on_uart_rx() {
+void HOT_FUNC(on_uart_rx)() {
     // just go line by line, no 
+    uint64_t start = rx_time_us();
+    uint32_t start_cycles = systick_hw->cvr;
+    uint32_t bytes = 0;
     while (uart_is_readable(UART_ID)) {
         uint8_t ch = uart_getc(UART_ID);
-        printf("%c", ch);
+        rx_bytes++;
+        bytes++;
+        feed_rx_byte(ch);  // complete frames are handed to the sinks, eg. the USB log
+    }
+    if (uart_get_hw(UART_ID)->rsr & UART_UARTRSR_OE_BITS) {
+        uart_get_hw(UART_ID)->rsr = 0;  // any write clears the error flags
+        rx_overruns++;
+    }
+    if ((flow_lines & FLOW_RTS) && !flow_held && flow_free_slots() <= FLOW_STOP_FREE) {
+        // RTS off by hand until service_flow() sees the main loop caught up
+        hw_clear_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTSEN_BITS | UART_UARTCR_RTS_BITS);
+        flow_held = 1;
+        flow_holds++;
+    }
+    uint32_t cycles = (start_cycles - systick_hw->cvr) & 0x00FFFFFF;  // SysTick counts down, 24 bits
+    rx_irq_us += rx_time_us() - start;
+    irq_count++;
+    irq_bytes += bytes;
+    irq_cycles += cycles;
+    if (cycles > irq_cycles_max)
+        irq_cycles_max = cycles;
+    if (bytes) {
+        if (cycles / bytes < irq_byte_cycles_min)
+            irq_byte_cycles_min = cycles / bytes;
+        if (cycles / bytes > irq_byte_cycles_max)
+            irq_byte_cycles_max = cycles / bytes;
     }
 
     // size_t len = 256;  // size of the buffer in bytes
@@ -89,29 +1498,15 @@ void on_uart_rx() {
 
 int get_checksum(char *string) {
     // adapted from: https://github.com/craigpeacock/NMEA-GPS/blob/master/gps.c
-    char *checksum_str;
-	// int checksum;
-	int calculated_checksum = 0;
-    // printf("calculating checksum\n");
-    char duplicate[strlen(string)];
-    strcpy(duplicate, string); // preserve the original string 
-
-	// Checksum is postcede by *
-	checksum_str = strchr(duplicate, '*');
-	if (checksum_str != NULL){
-		// Remove checksum from duplicate
-		*checksum_str = '\0';
-		// Calculate checksum, starting after $ (i = 1)
-		for (int i = 1; i < strlen(duplicate); i++) {
-			calculated_checksum = calculated_checksum ^ duplicate[i];  // exclusive OR
-		}
-        // printf("Calculated checksum (int): %u\n", calculated_checksum);
-        return calculated_checksum;
-	} else {
-		// printf("Error: Checksum missing or NULL NMEA message\r\n");
-		return 0;
-	}
-	return 0;
+    // XOR of everything between the $ and the *, which has to be there. works
+    // in place, the copy it used to make was a VLA one byte short of the terminator.
+    int calculated_checksum = 0;
+    char *checksum_str = strchr(string, '*');  // checksum is postcede by *
+    if (checksum_str == NULL)
+        return 0;  // checksum missing or NULL NMEA message
+    for (char *c = string + 1; c < checksum_str; c++)  // starting after $
+        calculated_checksum ^= *c;  // exclusive OR
+    return calculated_checksum;
 }
 
 
@@ -144,6 +1539,9 @@ void uart_rx_setup(void) {
     // Set up a RX interrupt
     // We need to set up the handler first
     // Select correct interrupt for the UART we are using
+    if (rx_enabled)
+        return;  // already set up, eg. by save_nav_database()
+    rx_enabled = 1;
     int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
 
     // And set up and enable the interrupt handlers
@@ -157,6 +1555,26 @@ void uart_rx_setup(void) {
 }
 
 
+void rx_pause(void) {
+    // for runs that push their own bytes through the UART parser (replays and
+    // benchmarks): mask the RX interrupt, whatever set it up earlier, and keep the
+    // live fix aside. bytes arriving meanwhile are lost, as with any overrun.
+    int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_enabled(UART_IRQ, false);
+    rx_paused_fix = last_fix;
+}
+
+
+void rx_resume(void) {
+    // start the live stream over from a clean parser, the run may have left it mid frame
+    int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
+    memset(&ubx_rx, 0, sizeof(ubx_rx));
+    memset(&nmea_rx, 0, sizeof(nmea_rx));
+    last_fix = rx_paused_fix;
+    irq_set_enabled(UART_IRQ, rx_enabled);
+}
+
+
 int extract_baud_rate(char *string) {
     // extract the new baud from the message
     printf("extracting baud rate...\n");
@@ -238,13 +1656,13 @@ void send_nmea(int testrun, int changing_baud) {
     for (int i=0; i < msg_count; i++) {
         int decimal_checksum;  // placeholder for the integer value checksum checksum
         decimal_checksum = get_checksum(messages[i]);  // calc the hex checksum and write it to the `checksum` array
-        char checksum[2];  // placeholder for hexadecimal checksum
+        char checksum[3];  // placeholder for hexadecimal checksum, two digits and the terminator
         strcpy(checksum, "");  // initialize to empty string to avoid junk values
-        sprintf(checksum, "%X", decimal_checksum);  // convert the decimal checksum to hexadecimal
+        sprintf(checksum, "%02X", decimal_checksum);  // convert the decimal checksum to hexadecimal, NMEA wants both digits
         // itoa(cs, checksum, 16);  // alternative to sprintf()
         // printf("%s", checksum);  // for debugging
         char msg_terminator[] = "\r\n";  // NMEA sentence terminator <cr><lr> == "\r\n"
-        char nmea_msg[strlen(messages[i]) + strlen(msg_terminator) + strlen(checksum)];  // placeholder for final message
+        char nmea_msg[strlen(messages[i]) + strlen(msg_terminator) + strlen(checksum) + 1];  // placeholder for final message
         strcpy(nmea_msg, "");  // initialize to empty string to avoid junk values
         compile_message(nmea_msg, messages[i], checksum, msg_terminator);  // assemble the components into the final msg
 
@@ -337,3 +1755,4204 @@ void send_ubx(int testrun) {
     }
 }
 
+
+
+uint32_t HOT_FUNC(ubx_u32)(const uint8_t *p) {
+    // UBX payloads are little endian
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+uint64_t HOT_FUNC(rx_time_us)(void) {
+    // time_us_64() without the call into flash: the raw registers, re-reading the
+    // low word if the high one moved underneath it
+    uint32_t hi = timer_hw->timerawh;
+    uint32_t lo;
+    while (1) {
+        lo = timer_hw->timerawl;
+        uint32_t next_hi = timer_hw->timerawh;
+        if (hi == next_hi)
+            break;
+        hi = next_hi;
+    }
+    return (uint64_t)hi << 32 | lo;
+}
+
+
+int HOT_FUNC(nmea_atoi)(const char *s) {
+    // atoi() for NMEA fields, which have no whitespace, without newlib in flash
+    int sign = 1, value = 0;
+    if (*s == '-') {
+        sign = -1;
+        s++;
+    }
+    while (*s >= '0' && *s <= '9')
+        value = value * 10 + (*s++ - '0');
+    return sign * value;
+}
+
+
+int HOT_FUNC(nmea_strncmp)(const char *a, const char *b, size_t n) {
+    // strncmp() for the receive path, only ever compared against 0
+    for (; n; n--, a++, b++) {
+        if (*a != *b)
+            return (unsigned char)*a - (unsigned char)*b;
+        if (!*a)
+            break;
+    }
+    return 0;
+}
+
+
+size_t HOT_FUNC(nmea_strlen)(const char *s) {
+    const char *p = s;
+    while (*p)
+        p++;
+    return p - s;
+}
+
+
+char HOT_FUNC(nmea_upper)(char c) {
+    // toupper() without newlib's table, which is in flash
+    return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+
+size_t HOT_FUNC(compile_ubx_msg)(uint8_t *ubx_msg, uint8_t msg_class, uint8_t msg_id,
+                       const uint8_t *payload, uint16_t len) {
+    // assemble a complete UBX frame (sync chars, header, payload, checksum) into
+    // `ubx_msg`, which must have room for `len` + 8 bytes. returns the frame size.
+    uint8_t ck_a = 0, ck_b = 0;
+    ubx_msg[0] = UBX_SYNC_CHAR_1;
+    ubx_msg[1] = UBX_SYNC_CHAR_2;
+    ubx_msg[2] = msg_class;
+    ubx_msg[3] = msg_id;
+    ubx_msg[4] = len & 0xFF;
+    ubx_msg[5] = len >> 8;
+    if (len)
+        memcpy(ubx_msg + 6, payload, len);
+    for (size_t i = 2; i < (size_t)len + 6; i++) {
+        // 8-bit fletcher checksum over class, id, length and payload
+        ck_a += ubx_msg[i];
+        ck_b += ck_a;
+    }
+    ubx_msg[len + 6] = ck_a;
+    ubx_msg[len + 7] = ck_b;
+    return (size_t)len + 8;
+}
+
+
+void send_ubx_frame(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len) {
+    // send a single copy of a UBX message. fire_ubx_msg() repeats the message so that
+    // config changes stick, which is wrong for polls and aiding data.
+    uint8_t ubx_msg[len + 8];
+    size_t n = compile_ubx_msg(ubx_msg, msg_class, msg_id, payload, len);
+    uart_write_blocking(UART_ID, ubx_msg, n);
+}
+
+
+int HOT_FUNC(ubx_parse_byte)(ubx_rx_t *rx, uint8_t ch) {
+    // feed one received byte into the UBX frame state machine. returns 1 if the
+    // byte was part of a UBX frame so the caller can skip echoing it.
+    switch (rx->state) {
+    case UBX_WAIT_SYNC_1:
+        if (ch != UBX_SYNC_CHAR_1)
+            return 0;  // NMEA or noise
+        rx->state = UBX_WAIT_SYNC_2;
+        return 1;
+    case UBX_WAIT_SYNC_2:
+        rx->state = ch == UBX_SYNC_CHAR_2 ? UBX_CLASS : UBX_WAIT_SYNC_1;
+        return 1;
+    case UBX_CLASS:
+        rx->msg_class = ch;
+        rx->ck_a = ch;
+        rx->ck_b = ch;
+        rx->state = UBX_ID;
+        return 1;
+    case UBX_ID:
+        rx->msg_id = ch;
+        break;
+    case UBX_LEN_1:
+        rx->len = ch;
+        break;
+    case UBX_LEN_2:
+        rx->len |= ch << 8;
+        break;
+    case UBX_PAYLOAD:
+        if (rx->streaming)
+            raw_stream_byte(rx, ch);
+        else
+            rx->payload[rx->idx] = ch;
+        rx->idx++;
+        break;
+    case UBX_CK_A:
+        if (ch != rx->ck_a) {
+            rx->state = UBX_WAIT_SYNC_1;  // corrupt frame, drop it
+            ubx_bad_frames++;
+            if (rx->streaming)
+                raw_stream_end(rx, 0);
+        } else {
+            rx->state = UBX_CK_B;
+        }
+        return 1;
+    case UBX_CK_B:
+        if (rx->streaming)
+            raw_stream_end(rx, ch == rx->ck_b);  // not published to the sinks, there's no buffer
+        else if (ch == rx->ck_b && !rx->frames_only)
+            handle_ubx_frame(rx->msg_class, rx->msg_id, rx->payload, rx->len);
+        if (ch != rx->ck_b)
+            ubx_bad_frames++;
+        rx->state = UBX_WAIT_SYNC_1;
+        return 1;
+    }
+
+    // running checksum for everything between the sync chars and the checksum itself
+    rx->ck_a += ch;
+    rx->ck_b += rx->ck_a;
+
+    switch (rx->state) {
+    case UBX_ID:
+        rx->state = UBX_LEN_1;
+        break;
+    case UBX_LEN_1:
+        rx->state = UBX_LEN_2;
+        break;
+    case UBX_LEN_2:
+        rx->idx = 0;
+        rx->streaming = ubx_is_streamed(rx->msg_class, rx->msg_id);
+        if (rx->streaming) {
+            if (rx->len > (rx->msg_id == UBX_RXM_RAWX ? RAWX_MAX_LEN : SFRBX_MAX_LEN)) {
+                rx->streaming = 0;
+                rx->state = UBX_WAIT_SYNC_1;  // a corrupt length, don't stream KBs of whatever follows
+                break;
+            }
+            rx->raw_open = NULL;
+            rx->raw_frame++;
+            if (rx->len > raw_largest)
+                raw_largest = rx->len;
+            rx->state = rx->len ? UBX_PAYLOAD : UBX_CK_A;
+        } else if (rx->len > UBX_MAX_PAYLOAD)
+            rx->state = UBX_WAIT_SYNC_1;  // too big to buffer, resync on the next frame
+        else
+            rx->state = rx->len ? UBX_PAYLOAD : UBX_CK_A;
+        break;
+    case UBX_PAYLOAD:
+        if (rx->idx == rx->len)
+            rx->state = UBX_CK_A;
+        break;
+    default:
+        break;
+    }
+    return 1;
+}
+
+
+void HOT_FUNC(handle_ubx_frame)(uint8_t msg_class, uint8_t msg_id, uint8_t *payload, uint16_t len) {
+    // called from the RX interrupt for each UBX frame that passed its checksum
+    frame_publish(FRAME_UBX, msg_class, msg_id, payload, len);
+    if (msg_class == UBX_CLASS_MGA && msg_id == UBX_MGA_DBD) {
+        // keep the whole frame so it can be sent back verbatim
+        if (nav_db_len + len + 8 <= sizeof(nav_db)) {
+            nav_db_len += compile_ubx_msg(nav_db + nav_db_len, msg_class, msg_id, payload, len);
+            nav_db_msgs++;
+        }
+        nav_db_last_rx_us = rx_time_us();
+    } else if (msg_class == UBX_CLASS_MGA && msg_id == UBX_MGA_ACK && len >= 4) {
+        if (payload[0] == 1)
+            mga_acks++;
+        else
+            mga_nacks++;
+    } else if (msg_class == UBX_CLASS_NAV && msg_id == UBX_NAV_POSECEF && len >= 20) {
+        last_ecef[0] = (int32_t)ubx_u32(payload + 4);
+        last_ecef[1] = (int32_t)ubx_u32(payload + 8);
+        last_ecef[2] = (int32_t)ubx_u32(payload + 12);
+        posecef_count++;
+    } else if (msg_class == UBX_CLASS_NAV && msg_id == UBX_NAV_SAT && len >= 8) {
+        decode_nav_sat(payload, len);
+    } else if (msg_class == UBX_CLASS_NAV && msg_id == UBX_NAV_PVT && len >= NAV_PVT_LEN) {
+        decode_nav_pvt(payload, &last_fix, fix_fields());
+        pvt_count++;
+    } else if (msg_class == UBX_CLASS_LOG && msg_id == UBX_LOG_BATCH && len >= LOG_BATCH_LEN) {
+        if (batch_count < BATCH_MAX_EPOCHS) {
+            nav_fix_t *fix = &batch_fixes[batch_count++];
+            memset(fix, 0, sizeof(*fix));
+            fix->itow = ubx_u32(&payload[4]);
+            fix->rx_us = rx_time_us();
+            fix->fix_type = payload[24];
+            fix->num_sv = payload[27];
+            fix->lon = (int32_t)ubx_u32(&payload[28]);
+            fix->lat = (int32_t)ubx_u32(&payload[32]);
+            fix->h_msl = (int32_t)ubx_u32(&payload[40]);
+            fix->h_acc = ubx_u32(&payload[44]);
+            fix->g_speed = (int32_t)ubx_u32(&payload[64]);
+        }
+        batch_bytes += len + 8;
+        batch_last_rx_us = rx_time_us();
+    } else if (msg_class == UBX_CLASS_NAV && msg_id == UBX_NAV_GEOFENCE && len >= 8) {
+        geofence_status = payload[5];
+        geofence_comb_state = payload[7];
+        for (int i = 0; i < payload[6] && i < GEOFENCE_MAX && 8 + 2 * i < len; i++)
+            geofence_states[i] = payload[8 + 2 * i];
+        geofence_link_bytes += len + 8;
+        geofence_replies++;
+    } else if (msg_class == UBX_CLASS_ACK && len >= 2) {
+        cfg_ack_class = payload[0];
+        cfg_ack_id = payload[1];
+        cfg_ack_ok = msg_id == UBX_ACK_ACK;
+        cfg_acks++;
+    } else if (msg_class == UBX_CLASS_CFG && msg_id == UBX_CFG_VALGET && len >= 4 && len <= sizeof(cfg_payload)) {
+        memcpy(cfg_payload, payload, len);
+        valget_len = len;
+        valget_count++;
+    } else if (msg_class == UBX_CLASS_MON && msg_id == UBX_MON_BATCH && len >= 12) {
+        batch_fill_level = payload[4] | (payload[5] << 8);
+        batch_last_rx_us = rx_time_us();
+    } else if (msg_class == UBX_CLASS_NAV && msg_id == UBX_NAV_STATUS && len >= 16) {
+        nav_fix_type = payload[4];
+        nav_fix_ok = payload[5] & 0x01;  // gpsFixOk
+        nav_ttff_ms = ubx_u32(&payload[8]);
+    }
+}
+
+
+int wait_for_mga_ack(uint32_t replies_before, uint32_t timeout_ms) {
+    // wait until the module acknowledges (or rejects) the last MGA message.
+    // returns 1 if it replied, 0 on timeout.
+    uint64_t deadline = time_us_64() + timeout_ms * 1000ULL;
+    while (mga_acks + mga_nacks == replies_before) {
+        if (time_us_64() > deadline)
+            return 0;
+        tight_loop_contents();
+    }
+    return 1;
+}
+
+
+void enable_mga_ack(void) {
+    // UBX-CFG-NAVX5 with only the ackAiding bit in mask1 set, so that the module
+    // answers every MGA message with an MGA-ACK. that's what the uploads use for
+    // flow control, otherwise the module's input buffer can overflow.
+    uint8_t payload[40] = { 0 };
+    payload[0] = 0x02;  // message version
+    payload[2] = 0x00;
+    payload[3] = 0x04;  // mask1 bit 10: ackAid
+    payload[17] = 1;    // ackAiding
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_NAVX5, payload, sizeof(payload));
+    busy_wait_ms(100);  // give the module time to apply it
+}
+
+
+void save_nav_database(int testrun) {
+    // poll the module's navigation database (ephemeris, almanac, health, ionosphere)
+    // with UBX-MGA-DBD and write it to the pico's flash. the M8030-KT has no flash
+    // and UPD-SOS can't persist this data, so without it every battery loss is a cold start.
+    if (testrun) {
+        printf("would poll UBX-MGA-DBD and save it to flash at 0x%X\n", NAV_DB_FLASH_OFFSET);
+        return;
+    }
+    uart_rx_setup();  // the dump comes back over RX
+
+    nav_db_len = sizeof(nav_db_header_t);
+    nav_db_msgs = 0;
+    nav_db_last_rx_us = time_us_64();
+    uint64_t start = time_us_64();
+    send_ubx_frame(UBX_CLASS_MGA, UBX_MGA_DBD, NULL, 0);  // an empty MGA-DBD is a poll
+
+    // the database comes as a burst of MGA-DBD messages with no terminator,
+    // so it's complete once the module goes quiet.
+    while (time_us_64() - nav_db_last_rx_us < NAV_DB_QUIET_MS * 1000ULL)
+        tight_loop_contents();
+
+    if (nav_db_msgs == 0) {
+        printf("no MGA-DBD messages received, leaving the flash cache untouched\n");
+        return;
+    }
+
+    nav_db_header_t header;
+    header.magic = NAV_DB_MAGIC;
+    header.len = nav_db_len - sizeof(header);
+    header.num_msgs = nav_db_msgs;
+    header.checksum = 0;
+    for (uint32_t i = sizeof(header); i < nav_db_len; i++)
+        header.checksum += nav_db[i];
+    memcpy(nav_db, &header, sizeof(header));
+
+    // erase whole sectors and program whole pages. interrupts must be off, the
+    // flash can't be read (ie. executed from) while it's being written.
+    uint32_t erase_len = (nav_db_len + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    uint32_t program_len = (nav_db_len + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(NAV_DB_FLASH_OFFSET, erase_len);
+    flash_range_program(NAV_DB_FLASH_OFFSET, nav_db, program_len);
+    restore_interrupts(ints);
+
+    printf("saved %lu MGA-DBD messages (%lu bytes) to flash in %llu ms\n",
+           (unsigned long)header.num_msgs, (unsigned long)header.len,
+           (time_us_64() - start) / 1000);
+}
+
+
+void restore_nav_database(int testrun) {
+    // stream the MGA-DBD messages cached by save_nav_database() back to the module,
+    // one at a time, waiting for each MGA-ACK before sending the next.
+    const uint8_t *cache = (const uint8_t *)(XIP_BASE + NAV_DB_FLASH_OFFSET);
+    nav_db_header_t header;
+    memcpy(&header, cache, sizeof(header));
+    if (header.magic != NAV_DB_MAGIC || header.len > NAV_DB_FLASH_SIZE - sizeof(header)) {
+        printf("no navigation database cached in flash\n");
+        return;
+    }
+    const uint8_t *frames = cache + sizeof(header);
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < header.len; i++)
+        checksum += frames[i];
+    if (checksum != header.checksum) {
+        printf("navigation database cache is corrupt, not restoring\n");
+        return;
+    }
+    if (testrun) {
+        printf("would restore %lu MGA-DBD messages (%lu bytes)\n",
+               (unsigned long)header.num_msgs, (unsigned long)header.len);
+        return;
+    }
+
+    upload_mga_blob(frames, header.len);
+}
+
+
+void report_ttff(const char *aiding) {
+    // poll UBX-NAV-STATUS until the module has a fix and print the time to first fix
+    // it measured, so starts with and without aiding can be compared.
+    uint64_t start = time_us_64();
+    nav_fix_ok = 0;
+    while (!nav_fix_ok && time_us_64() - start < TTFF_TIMEOUT_MS * 1000ULL) {
+        send_ubx_frame(UBX_CLASS_NAV, UBX_NAV_STATUS, NULL, 0);
+        sleep_ms(1000);
+    }
+    if (nav_fix_ok)
+        printf("TTFF with %s: %lu ms (fix type %d)\n",
+               aiding, (unsigned long)nav_ttff_ms, nav_fix_type);
+    else
+        printf("no fix after %d s\n", TTFF_TIMEOUT_MS / 1000);
+}
+
+
+int send_mga_frame(const uint8_t *frame, size_t len, int *acking) {
+    // send one MGA frame and hold off until the module has processed it. `acking` is
+    // cleared the first time no MGA-ACK ever arrives, after which fixed pacing is used.
+    // returns 1 if the module accepted the frame.
+    uint32_t acks = mga_acks;
+    uint32_t replies = mga_acks + mga_nacks;
+    uart_write_blocking(UART_ID, frame, len);
+    if (*acking) {
+        if (!wait_for_mga_ack(replies, MGA_ACK_TIMEOUT_MS) && replies == 0)
+            *acking = 0;
+    } else {
+        busy_wait_ms(MGA_UNACKED_GAP_MS);
+    }
+    return mga_acks != acks;
+}
+
+
+uint32_t upload_mga_blob(const uint8_t *blob, size_t len) {
+    // stream the UBX-MGA frames in `blob` to the module as fast as it acks them.
+    // non-MGA frames are skipped and the upload stops at the first byte that isn't
+    // a frame, eg. the erased (0xFF) tail of a flash region. returns frames sent.
+    uart_rx_setup();  // needed for the MGA-ACKs
+    enable_mga_ack();
+    uint64_t start = time_us_64();
+    int acking = 1;
+    uint32_t sent = 0, accepted = 0, skipped = 0;
+    size_t offset = 0;
+    while (offset + 8 <= len) {
+        const uint8_t *frame = blob + offset;
+        size_t frame_len = (frame[4] | (frame[5] << 8)) + 8;
+        if (frame[0] != UBX_SYNC_CHAR_1 || frame[1] != UBX_SYNC_CHAR_2 || offset + frame_len > len)
+            break;
+        offset += frame_len;
+        if (frame[2] != UBX_CLASS_MGA) {
+            skipped++;
+            continue;
+        }
+        accepted += send_mga_frame(frame, frame_len, &acking);
+        sent++;
+    }
+    uint64_t elapsed_ms = (time_us_64() - start) / 1000;
+    printf("uploaded %lu MGA messages (%lu bytes) in %llu ms: %lu accepted, %lu skipped%s\n",
+           (unsigned long)sent, (unsigned long)offset, elapsed_ms, (unsigned long)accepted,
+           (unsigned long)skipped, acking ? "" : ", module not acking");
+    return sent;
+}
+
+
+void upload_assistnow_flash(int testrun) {
+    // upload an AssistNow Offline (MGA-ANO) or Autonomous/almanac (MGA-GPS, MGA-GLO, ...)
+    // blob stored raw in the pico's flash. note that MGA-ANO data is only used once the
+    // module knows the approximate time, ie. it needs an RTC or an MGA-INI-TIME_UTC first.
+    const uint8_t *blob = (const uint8_t *)(XIP_BASE + MGA_BLOB_FLASH_OFFSET);
+    if (blob[0] != UBX_SYNC_CHAR_1 || blob[1] != UBX_SYNC_CHAR_2) {
+        printf("no AssistNow data in flash at 0x%X\n", MGA_BLOB_FLASH_OFFSET);
+        return;
+    }
+    if (testrun) {
+        printf("would upload AssistNow data from flash at 0x%X\n", MGA_BLOB_FLASH_OFFSET);
+        return;
+    }
+    upload_mga_blob(blob, MGA_BLOB_FLASH_SIZE);
+}
+
+
+void upload_assistnow_stdin(int testrun) {
+    // same as upload_assistnow_flash(), but the blob is a file piped in over USB,
+    // eg. `cat mgaoffline.ubx > /dev/ttyACM0`. frames are forwarded as they arrive, so
+    // the file can be any size, and the host is throttled by the module's acks.
+    if (testrun) {
+        printf("would upload AssistNow data read from USB\n");
+        return;
+    }
+    printf("waiting for AssistNow data over USB...\n");
+    uart_rx_setup();
+    enable_mga_ack();
+    uint8_t frame[UBX_MAX_PAYLOAD + 8];
+    uint64_t start = 0;
+    int acking = 1;
+    uint32_t sent = 0, accepted = 0, bytes = 0;
+    size_t idx = 0, frame_len = 8;
+    while (1) {
+        int c = getchar_timeout_us(sent || idx ? MGA_STDIN_TIMEOUT_US : 60 * MGA_STDIN_TIMEOUT_US);
+        if (c == PICO_ERROR_TIMEOUT)
+            break;
+        if (idx == 0 && c != UBX_SYNC_CHAR_1)
+            continue;  // resync on the next frame
+        if (idx == 0 && start == 0)
+            start = time_us_64();
+        frame[idx++] = c;
+        if (idx == 2 && c != UBX_SYNC_CHAR_2) {
+            idx = 0;
+            continue;
+        }
+        if (idx == 6) {
+            frame_len = (frame[4] | (frame[5] << 8)) + 8;
+            if (frame_len > sizeof(frame)) {
+                idx = 0;  // not something we can buffer, drop it
+                continue;
+            }
+        }
+        if (idx >= 6 && idx == frame_len) {
+            if (frame[2] == UBX_CLASS_MGA) {
+                accepted += send_mga_frame(frame, frame_len, &acking);
+                sent++;
+                bytes += frame_len;
+            }
+            idx = 0;
+        }
+    }
+    printf("uploaded %lu MGA messages (%lu bytes) in %llu ms: %lu accepted\n",
+           (unsigned long)sent, (unsigned long)bytes,
+           start ? (time_us_64() - start) / 1000 : 0ULL, (unsigned long)accepted);
+}
+
+
+void change_baud_rate(int baud) {
+    // switch the module's UART1 to `baud` with a PUBX,41 message, then follow it
+    // on the pico. unlike send_nmea() it's only sent once, repeats would arrive
+    // at the old baud after the module has already switched.
+    char raw_msg[32];
+    char nmea_msg[40];
+    sprintf(raw_msg, "$PUBX,41,1,3,3,%d,0*", baud);
+    sprintf(nmea_msg, "%s%02X\r\n", raw_msg, get_checksum(raw_msg));
+    uart_write_blocking(UART_ID, (uint8_t *)nmea_msg, strlen(nmea_msg));
+    uart_tx_wait_blocking(UART_ID);  // the whole message has to go out at the old baud
+    busy_wait_ms(50);  // the module switches after it has processed the message
+    uart_set_baudrate(UART_ID, baud);
+    current_baud = baud;
+}
+
+
+void configure_batching(int testrun, uint16_t epochs) {
+    // UBX-CFG-BATCH: have the module store up to `epochs` fixes (with the extra PVT
+    // fields) in its own buffer instead of the pico having to receive every epoch.
+    // 0 disables batching.
+    uint8_t payload[12] = { 0 };
+    payload[0] = 0x00;                  // message version
+    payload[1] = epochs ? 0x05 : 0x00;  // enable | extraPvt
+    payload[2] = epochs & 0xFF;         // bufSize
+    payload[3] = epochs >> 8;
+    payload[4] = epochs & 0xFF;         // notifThrs, only matters with pioEnable
+    payload[5] = epochs >> 8;
+    if (testrun) {
+        printf("would configure batching of %d epochs\n", epochs);
+        return;
+    }
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_BATCH, payload, sizeof(payload));
+    busy_wait_ms(100);
+}
+
+
+uint32_t retrieve_batch(void) {
+    // UBX-LOG-RETRIEVEBATCH with sendMonFirst set, so that the MON-BATCH fill level
+    // arrives first and it's known how many LOG-BATCH messages to expect.
+    uint8_t payload[4] = { 0x00, 0x01, 0x00, 0x00 };
+    batch_count = 0;
+    batch_bytes = 0;
+    batch_fill_level = -1;
+    batch_last_rx_us = time_us_64();
+    send_ubx_frame(UBX_CLASS_LOG, UBX_LOG_RETRIEVEBATCH, payload, sizeof(payload));
+    while (time_us_64() - batch_last_rx_us < BATCH_QUIET_MS * 1000ULL) {
+        if (batch_fill_level >= 0 && batch_count >= (uint32_t)batch_fill_level)
+            break;
+        tight_loop_contents();
+    }
+    return batch_count;
+}
+
+
+void run_batching_cycle(int testrun, uint16_t epochs) {
+    // low power tracking: the module batches fixes on its own while the pico sleeps,
+    // then the pico wakes, raises the baud and pulls them all in one burst. prints how
+    // long the link was busy compared with receiving every epoch as it happens.
+    if (epochs > BATCH_MAX_EPOCHS)
+        epochs = BATCH_MAX_EPOCHS;
+    configure_batching(testrun, epochs);
+    if (testrun)
+        return;
+    uart_rx_setup();
+
+    printf("sleeping while the module batches %d epochs\n", epochs);
+    sleep_ms((uint32_t)epochs * nav_period_ms);
+
+    int baud = current_baud;
+    uint64_t start = time_us_64();
+    change_baud_rate(BATCH_RETRIEVE_BAUD);
+    uint32_t n = retrieve_batch();
+    change_baud_rate(baud);
+    uint64_t awake_us = time_us_64() - start;
+
+    // streaming the same fixes means a NAV-PVT (92 byte payload, 100 on the wire)
+    // every epoch at the normal baud, with the pico awake for the whole period.
+    uint64_t stream_link_us = (uint64_t)n * (NAV_PVT_LEN + 8) * 10 * 1000000 / baud;
+    uint64_t stream_awake_us = (uint64_t)epochs * nav_period_ms * 1000;
+    printf("retrieved %lu of %ld batched fixes (%lu bytes) in %llu ms at %d baud\n",
+           (unsigned long)n, (long)batch_fill_level, (unsigned long)batch_bytes,
+           awake_us / 1000, BATCH_RETRIEVE_BAUD);
+    printf("streaming: link busy %llu ms, pico awake %llu ms; batching: pico awake %.2f%% of that\n",
+           stream_link_us / 1000, stream_awake_us / 1000,
+           stream_awake_us ? 100.0 * awake_us / stream_awake_us : 0.0);
+    if (n > 0)
+        printf("last fix: lat %ld lon %ld (1e-7 deg), fix type %d, %d SVs\n",
+               (long)batch_fixes[n - 1].lat, (long)batch_fixes[n - 1].lon,
+               batch_fixes[n - 1].fix_type, batch_fixes[n - 1].num_sv);
+}
+
+
+void HOT_FUNC(decode_nav_pvt)(const uint8_t *payload, nav_fix_t *fix, uint8_t fields) {
+    // unpack the groups of UBX-NAV-PVT fields in `fields`, see FIX_*
+    if (fields & FIX_TIME) {
+        fix->itow = ubx_u32(&payload[0]);
+        fix->hour = payload[8];
+        fix->min = payload[9];
+        fix->sec = payload[10];
+        fix->nano = (int32_t)ubx_u32(&payload[16]);
+    }
+    if (fields & FIX_DATE) {
+        fix->year = payload[4] | (payload[5] << 8);
+        fix->month = payload[6];
+        fix->day = payload[7];
+        fix->valid = payload[11];
+    }
+    if (fields & FIX_QUALITY) {
+        fix->fix_type = payload[20];
+        fix->flags = payload[21];
+        fix->num_sv = payload[23];
+    }
+    if (fields & FIX_POSITION) {
+        fix->lon = (int32_t)ubx_u32(&payload[24]);
+        fix->lat = (int32_t)ubx_u32(&payload[28]);
+    }
+    if (fields & FIX_ALTITUDE) {
+        fix->height = (int32_t)ubx_u32(&payload[32]);
+        fix->h_msl = (int32_t)ubx_u32(&payload[36]);
+    }
+    if (fields & FIX_VELOCITY) {
+        fix->vel_n = (int32_t)ubx_u32(&payload[48]);
+        fix->vel_e = (int32_t)ubx_u32(&payload[52]);
+        fix->vel_d = (int32_t)ubx_u32(&payload[56]);
+        fix->g_speed = (int32_t)ubx_u32(&payload[60]);
+        fix->head_mot = (int32_t)ubx_u32(&payload[64]);
+    }
+    if (fields & FIX_ACCURACY) {
+        fix->h_acc = ubx_u32(&payload[40]);
+        fix->v_acc = ubx_u32(&payload[44]);
+        fix->s_acc = ubx_u32(&payload[68]);
+        fix->p_dop = payload[76] | (payload[77] << 8);
+    }
+    fix->rx_us = rx_time_us();
+}
+
+
+void set_nmea_rate(const char *identifier, int rate) {
+    // PUBX,40 for a single sentence on USART1 only, sent once. `rate` is per epoch,
+    // 0 turns the sentence off.
+    char raw_msg[32];
+    char nmea_msg[40];
+    sprintf(raw_msg, "$PUBX,40,%s,0,%d,0,0*", identifier, rate);
+    sprintf(nmea_msg, "%s%02X\r\n", raw_msg, get_checksum(raw_msg));
+    uart_write_blocking(UART_ID, (uint8_t *)nmea_msg, strlen(nmea_msg));
+}
+
+
+void set_ubx_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate) {
+    // short form of UBX-CFG-MSG, sets the output rate on the port it arrives on
+    uint8_t payload[3] = { msg_class, msg_id, rate };
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+}
+
+
+void set_ubx_port_rates(uint8_t msg_class, uint8_t msg_id, uint8_t ddc_rate, uint8_t uart_rate) {
+    // long form of UBX-CFG-MSG, a rate for each port: DDC, UART1, UART2, USB, SPI.
+    // the others are turned off.
+    uint8_t payload[8] = { msg_class, msg_id, ddc_rate, uart_rate, 0, 0, 0, 0 };
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+}
+
+
+void set_poll_mode(int testrun, int enable) {
+    // poll mode turns off all periodic output, positions are then only sent when
+    // requested. disabling it goes back to the GGA + ZDA stream send_nmea() sets up.
+    char *identifiers[] = { "GGA", "GLL", "GSA", "GSV", "RMC", "VTG", "ZDA" };
+    int num_identifiers = sizeof(identifiers) / sizeof(identifiers[0]);
+    if (testrun) {
+        printf("would %s poll mode\n", enable ? "enable" : "disable");
+        return;
+    }
+    for (int i = 0; i < num_identifiers; i++) {
+        int periodic = strcmp(identifiers[i], "GGA") == 0 || strcmp(identifiers[i], "ZDA") == 0;
+        set_nmea_rate(identifiers[i], enable ? 0 : periodic);
+    }
+    set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_PVT, 0);  // only polled, never periodic
+    uart_rx_setup();
+}
+
+
+int request_position(fix_callback_t callback) {
+    // ask for a fresh NAV-PVT and call `callback` from service_position_requests()
+    // when it arrives. requests made while a poll is already outstanding share it,
+    // so several consumers asking at once cost one poll. returns 0 if the waiter
+    // list is full.
+    if (num_fix_waiters == MAX_FIX_WAITERS)
+        return 0;
+    fix_waiters[num_fix_waiters++] = callback;
+    if (num_fix_waiters == 1) {
+        pvt_poll_count = pvt_count;
+        pvt_poll_sent_us = time_us_64();
+        send_ubx_frame(UBX_CLASS_NAV, UBX_NAV_PVT, NULL, 0);  // an empty NAV-PVT is a poll
+    }
+    return 1;
+}
+
+
+void service_position_requests(void) {
+    // called from the main loop. hands the reply to every waiting consumer, outside
+    // of the interrupt, and resends polls that got lost.
+    if (num_fix_waiters == 0)
+        return;
+    if (pvt_count == pvt_poll_count) {
+        if (time_us_64() - pvt_poll_sent_us > PVT_POLL_TIMEOUT_MS * 1000ULL) {
+            pvt_poll_sent_us = time_us_64();
+            send_ubx_frame(UBX_CLASS_NAV, UBX_NAV_PVT, NULL, 0);
+        }
+        return;
+    }
+    uint32_t ints = save_and_disable_interrupts();
+    nav_fix_t fix = last_fix;  // consistent copy, the RX interrupt may overwrite it
+    restore_interrupts(ints);
+    int n = num_fix_waiters;
+    num_fix_waiters = 0;  // callbacks may request again
+    for (int i = 0; i < n; i++)
+        fix_waiters[i](&fix);
+}
+
+
+void print_fix(const nav_fix_t *fix) {
+    printf("fix %d (%d SVs): lat %ld lon %ld (1e-7 deg) alt %ld mm, %ld mm/s\n",
+           fix->fix_type, fix->num_sv, (long)fix->lat, (long)fix->lon,
+           (long)fix->h_msl, (long)fix->g_speed);
+}
+
+
+void compare_poll_vs_stream(int testrun, uint32_t seconds, uint32_t poll_interval_ms) {
+    // measure the UART bytes and RX interrupt time of the periodic stream, then of
+    // poll mode at `poll_interval_ms`, over `seconds` each
+    if (testrun || poll_interval_ms == 0)
+        return;
+    uart_rx_setup();
+    for (int mode = 0; mode < 2; mode++) {
+        set_poll_mode(testrun, mode);
+        sleep_ms(1000);  // let the output settle after the switch
+        uint32_t bytes = rx_bytes;
+        uint64_t irq_us = rx_irq_us;
+        uint32_t fixes = pvt_count;
+        uint64_t start = time_us_64();
+        uint64_t next_poll_us = start;
+        while (time_us_64() - start < seconds * 1000000ULL) {
+            if (mode == 1 && time_us_64() >= next_poll_us) {
+                request_position(print_fix);
+                next_poll_us += poll_interval_ms * 1000ULL;
+            }
+            service_position_requests();
+        }
+        printf("%s: %lu bytes/s, RX interrupt %.2f%% CPU, %lu NAV-PVT\n",
+               mode ? "poll mode" : "periodic", (unsigned long)((rx_bytes - bytes) / seconds),
+               100.0 * (rx_irq_us - irq_us) / (seconds * 1000000.0), (unsigned long)(pvt_count - fixes));
+    }
+    set_poll_mode(testrun, 0);
+}
+
+
+uint32_t replay_from_stdin(fix_callback_t on_fix) {
+    // feed a recorded log (raw UART capture) piped in over USB through the same
+    // parser the RX interrupt uses, calling `on_fix` for every NAV-PVT in it.
+    // the RX interrupt is masked meanwhile. returns the bytes replayed.
+    uint32_t bytes = 0;
+    rx_pause();
+    uint32_t fixes = pvt_count;
+    printf("waiting for a log over USB...\n");
+    int c = getchar_timeout_us(60 * REPLAY_TIMEOUT_US);
+    while (c != PICO_ERROR_TIMEOUT) {
+        feed_rx_byte(c);
+        bytes++;
+        if (pvt_count != fixes) {
+            fixes = pvt_count;
+            if (on_fix)
+                on_fix(&last_fix);
+        }
+        c = getchar_timeout_us(REPLAY_TIMEOUT_US);
+    }
+    rx_resume();
+    return bytes;
+}
+
+
+void set_nav_rate(uint16_t period_ms) {
+    // UBX-CFG-RATE: one navigation solution per measurement, aligned to GPS time.
+    // ZDA is kept at about 1 Hz whatever the nav rate is.
+    uint8_t payload[6] = { period_ms & 0xFF, period_ms >> 8, 0x01, 0x00, 0x01, 0x00 };
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_RATE, payload, sizeof(payload));
+    set_nmea_rate("ZDA", 1000 / period_ms);
+    nav_period_ms = period_ms;
+}
+
+
+int update_nav_rate(const nav_fix_t *fix, int dry_run) {
+    // move one step along rate_periods_ms if the ground speed has left the current
+    // step's hysteresis band. fixes without gnssFixOK or with a poor horizontal
+    // accuracy are ignored, their speed isn't worth reacting to. returns 1 on a change.
+    if (fix->fix_type < 2 || !(fix->flags & 0x01) || fix->h_acc > RATE_MAX_H_ACC)
+        return 0;
+    if (rate_changes > 0 && fix->itow - rate_changed_itow < RATE_MIN_DWELL_MS)
+        return 0;
+    int step = rate_step;
+    if (fix->g_speed > rate_up_speed[step] && step < RATE_STEPS - 1)
+        step++;
+    else if (fix->g_speed < rate_down_speed[step] && step > 0)
+        step--;
+    if (step == rate_step)
+        return 0;
+    rate_step = step;
+    rate_changed_itow = fix->itow;
+    rate_changes++;
+    if (dry_run)
+        nav_period_ms = rate_periods_ms[step];
+    else
+        set_nav_rate(rate_periods_ms[step]);
+    return 1;
+}
+
+
+void adaptive_rate_fix(const nav_fix_t *fix) {
+    // the log was recorded at a fixed rate, so drop the epochs the module wouldn't
+    // have produced at the rate the controller is at
+    sim_log_epochs++;
+    if (sim_epochs > 0 && fix->itow - sim_last_itow < nav_period_ms)
+        return;
+    sim_epochs++;
+    sim_last_itow = fix->itow;
+    update_nav_rate(fix, 1);
+}
+
+
+void simulate_adaptive_rate(void) {
+    // replay a flight log (recorded with NAV-PVT at the fastest rate) through the
+    // controller and report how often it changed rate and the link and processing
+    // load compared with staying at the fastest rate.
+    rate_step = 0;
+    rate_changes = 0;
+    nav_period_ms = rate_periods_ms[0];
+    sim_epochs = 0;
+    sim_log_epochs = 0;
+    uint32_t bytes = replay_from_stdin(adaptive_rate_fix);
+    if (sim_log_epochs == 0) {
+        printf("no NAV-PVT in the replayed log\n");
+        return;
+    }
+    uint32_t bytes_per_epoch = bytes / sim_log_epochs;
+    printf("adaptive rate: %lu rate changes over %lu epochs\n",
+           (unsigned long)rate_changes, (unsigned long)sim_log_epochs);
+    printf("link: %lu bytes vs %lu at the fixed rate; epochs decoded %.1f%% of fixed "
+           "(pico and module processing scale with this)\n",
+           (unsigned long)(sim_epochs * bytes_per_epoch), (unsigned long)bytes,
+           100.0 * sim_epochs / sim_log_epochs);
+}
+
+
+uint16_t HOT_FUNC(crc_x25)(const uint8_t *data, size_t len, uint16_t crc) {
+    // table driven, one lookup per byte. start with crc = 0xFFFF.
+    for (size_t i = 0; i < len; i++)
+        crc = (crc >> 8) ^ crc_x25_table[(crc ^ data[i]) & 0xFF];
+    return crc;
+}
+
+
+uint32_t days_from_civil(int year, int month, int day) {
+    // days since 1970-01-01 for a gregorian date
+    year -= month <= 2;
+    int era = year / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+
+uint64_t fix_unix_time_us(const nav_fix_t *fix) {
+    // UTC of the fix in unix microseconds, 0 if the module hasn't resolved date and time
+    if ((fix->valid & 0x03) != 0x03)
+        return 0;
+    uint64_t s = (uint64_t)days_from_civil(fix->year, fix->month, fix->day) * 86400
+                 + fix->hour * 3600 + fix->min * 60 + fix->sec;
+    return s * 1000000 + fix->nano / 1000;  // nano can be negative, it's relative to sec
+}
+
+
+void mavlink_uart_setup(void) {
+    // TX only. frames are handed to a DMA channel so that sending them costs no
+    // CPU time after encoding.
+    uart_init(MAVLINK_UART_ID, MAVLINK_BAUD_RATE);
+    gpio_set_function(MAVLINK_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(MAVLINK_RX_PIN, GPIO_FUNC_UART);
+    uart_set_format(MAVLINK_UART_ID, DATA_BITS, STOP_BITS, PARITY);
+
+    mavlink_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(mavlink_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(MAVLINK_UART_ID, true));
+    dma_channel_configure(mavlink_dma_chan, &c, &uart_get_hw(MAVLINK_UART_ID)->dr,
+                          NULL, 0, false);
+}
+
+
+size_t mavlink_finalize(uint8_t *frame, uint8_t msg_id, size_t len, uint8_t crc_extra) {
+    // fill in the MAVLink 2 header around a payload already at frame + MAVLINK_HEADER_LEN
+    // and append the checksum. returns the frame size.
+    while (len > 1 && frame[MAVLINK_HEADER_LEN + len - 1] == 0)
+        len--;  // MAVLink 2 drops trailing zero bytes of the payload
+    frame[0] = MAVLINK_STX;
+    frame[1] = len;
+    frame[2] = 0;  // incompat flags
+    frame[3] = 0;  // compat flags
+    frame[4] = mavlink_seq++;
+    frame[5] = MAVLINK_SYSTEM_ID;
+    frame[6] = MAVLINK_COMPONENT_ID;
+    frame[7] = msg_id;  // 24 bit message id
+    frame[8] = 0;
+    frame[9] = 0;
+    uint16_t crc = crc_x25(frame + 1, MAVLINK_HEADER_LEN - 1 + len, 0xFFFF);
+    crc = crc_x25(&crc_extra, 1, crc);
+    frame[MAVLINK_HEADER_LEN + len] = crc & 0xFF;
+    frame[MAVLINK_HEADER_LEN + len + 1] = crc >> 8;
+    return MAVLINK_HEADER_LEN + len + 2;
+}
+
+
+uint8_t mavlink_fix_type(const nav_fix_t *fix) {
+    // NAV-PVT fixType and flags to GPS_FIX_TYPE
+    if (!(fix->flags & 0x01) || fix->fix_type < 2 || fix->fix_type > 4)
+        return 1;  // no fix
+    if (fix->fix_type == 2)
+        return 2;
+    if ((fix->flags >> 6) == 2)
+        return 6;  // RTK fixed
+    if ((fix->flags >> 6) == 1)
+        return 5;  // RTK float
+    return fix->flags & 0x02 ? 4 : 3;  // DGPS when differential corrections were applied
+}
+
+
+size_t mavlink_encode_gps_raw_int(uint8_t *frame, const nav_fix_t *fix) {
+    // fields in MAVLink wire order: largest type first, then the extensions
+    uint8_t *p = frame + MAVLINK_HEADER_LEN;
+    uint64_t time_usec = fix_unix_time_us(fix);
+    if (time_usec == 0)
+        time_usec = fix->rx_us;  // time since boot is allowed too
+    uint16_t unknown = UINT16_MAX;
+    uint16_t vel = fix->g_speed / 10;  // cm/s
+    uint16_t cog = (fix->head_mot / 1000) % 36000;  // cdeg
+    uint32_t hdg_acc = 0;
+    memset(p, 0, MAVLINK_MSG_GPS_RAW_INT_LEN);
+    memcpy(p + 0, &time_usec, 8);
+    memcpy(p + 8, &fix->lat, 4);
+    memcpy(p + 12, &fix->lon, 4);
+    memcpy(p + 16, &fix->h_msl, 4);
+    memcpy(p + 20, &unknown, 2);  // eph, NAV-PVT has no HDOP, h_acc below replaces it
+    memcpy(p + 22, &unknown, 2);  // epv
+    memcpy(p + 24, &vel, 2);
+    memcpy(p + 26, &cog, 2);
+    p[28] = mavlink_fix_type(fix);
+    p[29] = fix->num_sv;
+    memcpy(p + 30, &fix->height, 4);  // alt_ellipsoid
+    memcpy(p + 34, &fix->h_acc, 4);
+    memcpy(p + 38, &fix->v_acc, 4);
+    memcpy(p + 42, &fix->s_acc, 4);  // vel_acc
+    memcpy(p + 46, &hdg_acc, 4);
+    // yaw (p + 50) stays 0, not available
+    return mavlink_finalize(frame, MAVLINK_MSG_GPS_RAW_INT, MAVLINK_MSG_GPS_RAW_INT_LEN,
+                            MAVLINK_MSG_GPS_RAW_INT_CRC);
+}
+
+
+size_t mavlink_encode_gps_input(uint8_t *frame, const nav_fix_t *fix) {
+    // same order rules as GPS_RAW_INT. the floats are a handful of soft-float
+    // divisions per epoch, cheap next to the rest of the encoding.
+    uint8_t *p = frame + MAVLINK_HEADER_LEN;
+    uint64_t time_usec = fix_unix_time_us(fix);
+    uint16_t time_week = 0;
+    if (time_usec)
+        time_week = (time_usec / 1000000 - GPS_UNIX_OFFSET_S + GPS_LEAP_SECONDS) / 604800;
+    else
+        time_usec = fix->rx_us;
+    float alt = fix->h_msl / 1000.0f;
+    float unknown = 0.0f;
+    float vn = fix->vel_n / 1000.0f;
+    float ve = fix->vel_e / 1000.0f;
+    float vd = fix->vel_d / 1000.0f;
+    float speed_acc = fix->s_acc / 1000.0f;
+    float h_acc = fix->h_acc / 1000.0f;
+    float v_acc = fix->v_acc / 1000.0f;
+    uint16_t ignore_flags = 0x02 | 0x04;  // HDOP, VDOP
+    memset(p, 0, MAVLINK_MSG_GPS_INPUT_LEN);
+    memcpy(p + 0, &time_usec, 8);
+    memcpy(p + 8, &fix->itow, 4);  // time_week_ms
+    memcpy(p + 12, &fix->lat, 4);
+    memcpy(p + 16, &fix->lon, 4);
+    memcpy(p + 20, &alt, 4);
+    memcpy(p + 24, &unknown, 4);  // hdop
+    memcpy(p + 28, &unknown, 4);  // vdop
+    memcpy(p + 32, &vn, 4);
+    memcpy(p + 36, &ve, 4);
+    memcpy(p + 40, &vd, 4);
+    memcpy(p + 44, &speed_acc, 4);
+    memcpy(p + 48, &h_acc, 4);
+    memcpy(p + 52, &v_acc, 4);
+    memcpy(p + 56, &ignore_flags, 2);
+    memcpy(p + 58, &time_week, 2);
+    p[60] = 0;  // gps_id
+    p[61] = mavlink_fix_type(fix);
+    p[62] = fix->num_sv;
+    return mavlink_finalize(frame, MAVLINK_MSG_GPS_INPUT, MAVLINK_MSG_GPS_INPUT_LEN,
+                            MAVLINK_MSG_GPS_INPUT_CRC);
+}
+
+
+int mavlink_send_fix(const nav_fix_t *fix, int msg) {
+    // encode the epoch into the free buffer and start the DMA. never waits: returns
+    // 0 if the previous frame is still going out, the sink retries it later.
+    if (mavlink_dma_chan < 0)
+        return 1;  // nowhere to send it, consume it
+    if (dma_channel_is_busy(mavlink_dma_chan))
+        return 0;
+    uint32_t start = time_us_32();
+    uint8_t *frame = mavlink_buf[mavlink_buf_idx];
+    size_t len = msg == 2 ? mavlink_encode_gps_input(frame, fix)
+                          : mavlink_encode_gps_raw_int(frame, fix);
+    uint32_t encode_us = time_us_32() - start;
+    dma_channel_transfer_from_buffer_now(mavlink_dma_chan, frame, len);
+    mavlink_buf_idx ^= 1;
+
+    mavlink_sent++;
+    mavlink_encode_us += encode_us;
+    if (encode_us > mavlink_encode_max_us)
+        mavlink_encode_max_us = encode_us;
+    // the last byte is on the wire 10 bits per byte after the DMA starts
+    mavlink_latency_us += time_us_64() - fix->rx_us + (uint64_t)len * 10 * 1000000 / MAVLINK_BAUD_RATE;
+    return 1;
+}
+
+
+void print_mavlink_stats(void) {
+    if (mavlink_sent == 0)
+        return;
+    printf("mavlink: %lu sent, encode %lu us avg / %lu us max, epoch to wire %lu us avg\n",
+           (unsigned long)mavlink_sent,
+           (unsigned long)(mavlink_encode_us / mavlink_sent), (unsigned long)mavlink_encode_max_us,
+           (unsigned long)(mavlink_latency_us / mavlink_sent));
+}
+
+
+void regmap_update(const nav_fix_t *fix) {
+    // fill the buffer the host isn't reading and then flip to it, so that a read
+    // transaction never sees half an epoch. called from the main loop once per epoch.
+    int target = regmap_active ^ 1;
+    if (regmap_reading == target) {
+        // the host is still in a transaction that latched this buffer before the last
+        // flip. it's been stale for a whole epoch already, the next update gets it.
+        regmap_skipped++;
+        return;
+    }
+    regmap_t *r = &regmap[target];
+    r->version = REGMAP_VERSION;
+    r->size = sizeof(regmap_t);
+    r->seq = regmap[regmap_active].seq + 1;
+    r->itow = fix->itow;
+    r->year = fix->year;
+    r->month = fix->month;
+    r->day = fix->day;
+    r->hour = fix->hour;
+    r->min = fix->min;
+    r->sec = fix->sec;
+    r->valid = fix->valid;
+    r->nano = fix->nano;
+    r->fix_type = fix->fix_type;
+    r->flags = fix->flags;
+    r->num_sv = fix->num_sv;
+    r->reserved = 0;
+    r->lat = fix->lat;
+    r->lon = fix->lon;
+    r->h_msl = fix->h_msl;
+    r->h_acc = fix->h_acc;
+    r->v_acc = fix->v_acc;
+    r->vel_n = fix->vel_n;
+    r->vel_e = fix->vel_e;
+    r->vel_d = fix->vel_d;
+    r->g_speed = fix->g_speed;
+    r->head_mot = fix->head_mot;
+    r->age_ms = (time_us_64() - fix->rx_us) / 1000;
+    r->rx_bytes = rx_bytes;
+    r->pvt_count = pvt_count;
+    r->ubx_bad_frames = ubx_bad_frames;
+    __dmb();  // the contents have to land before the index does
+    regmap_active = target;
+}
+
+
+void regmap_i2c_handler(i2c_inst_t *i2c, i2c_slave_event_t event) {
+    // runs in the I2C interrupt, a byte at a time, so every read is served in the
+    // same few cycles no matter what the parser is doing
+    switch (event) {
+    case I2C_SLAVE_RECEIVE:
+        if (!regmap_addressed) {
+            regmap_reg = i2c_read_byte_raw(i2c);
+            regmap_addressed = 1;
+        } else {
+            i2c_read_byte_raw(i2c);  // the map is read only
+        }
+        break;
+    case I2C_SLAVE_REQUEST:
+        if (regmap_reading < 0)
+            regmap_reading = regmap_active;  // latch one epoch for the whole transaction
+        if (regmap_reg < sizeof(regmap_t))
+            i2c_write_byte_raw(i2c, ((uint8_t *)&regmap[regmap_reading])[regmap_reg++]);
+        else
+            i2c_write_byte_raw(i2c, 0xFF);  // past the end of the map
+        break;
+    case I2C_SLAVE_FINISH:
+        regmap_addressed = 0;
+        regmap_reading = -1;
+        break;
+    }
+}
+
+
+void regmap_setup(void) {
+    gpio_init(REGMAP_SDA_PIN);
+    gpio_set_function(REGMAP_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(REGMAP_SDA_PIN);
+    gpio_init(REGMAP_SCL_PIN);
+    gpio_set_function(REGMAP_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(REGMAP_SCL_PIN);
+    memset(regmap, 0, sizeof(regmap));
+    regmap[0].version = REGMAP_VERSION;
+    regmap[0].size = sizeof(regmap_t);
+    i2c_init(REGMAP_I2C_ID, REGMAP_I2C_BAUD);
+    i2c_slave_init(REGMAP_I2C_ID, REGMAP_I2C_ADDRESS, regmap_i2c_handler);
+}
+
+
+size_t regmap_emulate_read(uint8_t reg, uint8_t *buf, size_t len) {
+    // stand-in for a host: goes through the same offset / latch / finish sequence
+    // as a real `write reg, repeated start, read len` transaction, without the bus.
+    // lets the map be checked from the USB console when no host MCU is wired up.
+    uint32_t ints = save_and_disable_interrupts();  // the real handler can't run meanwhile
+    regmap_reg = reg;
+    regmap_reading = regmap_active;
+    for (size_t i = 0; i < len; i++)
+        buf[i] = regmap_reg < sizeof(regmap_t) ? ((uint8_t *)&regmap[regmap_reading])[regmap_reg++] : 0xFF;
+    regmap_addressed = 0;
+    regmap_reading = -1;
+    restore_interrupts(ints);
+    return len;
+}
+
+
+void print_regmap_stats(void) {
+    // read the map back through the host stand-in, as a host would see it
+    regmap_t r;
+    regmap_emulate_read(0, (uint8_t *)&r, sizeof(r));
+    printf("regmap v%d: seq %u, fix %d, lat %ld lon %ld, age %lu ms, %lu updates skipped\n",
+           r.version, r.seq, r.fix_type, (long)r.lat, (long)r.lon,
+           (unsigned long)r.age_ms, (unsigned long)regmap_skipped);
+}
+
+
+int HOT_FUNC(nmea_parse_byte)(nmea_rx_t *rx, uint8_t ch) {
+    // collect an NMEA sentence from `$` up to and including the line feed.
+    // returns 1 if the byte was part of a sentence.
+    if (ch == '$') {
+        rx->line[0] = ch;
+        rx->len = 1;
+        rx->checksum = 0;
+        rx->sum_a = 0;
+        rx->sum_b = 0;
+        rx->star = 0;
+        return 1;
+    }
+    if (rx->len == 0)
+        return 0;  // noise between sentences
+    if (rx->len == NMEA_MAX_LEN) {
+        rx->len = 0;  // runaway sentence, wait for the next `$`
+        return 1;
+    }
+    if (ch == '*' && !rx->star)
+        rx->star = rx->len;
+    else if (!rx->star) {
+        rx->checksum ^= ch;  // checked at the end of the line, no second pass over it
+        rx->sum_a += ch;
+        rx->sum_b += rx->sum_a;
+    }
+    rx->line[rx->len++] = ch;
+    if (ch == '\n') {
+        if (rx->star && rx->len >= rx->star + 3
+            && nmea_upper(rx->line[rx->star + 1]) == hex_digits[rx->checksum >> 4]
+            && nmea_upper(rx->line[rx->star + 2]) == hex_digits[rx->checksum & 0x0F])
+            handle_nmea_sentence(rx->line, rx->len,
+                                 rx->checksum | (rx->sum_a << 8) | ((uint32_t)rx->sum_b << 16));
+        else
+            nmea_bad_sentences++;
+        rx->len = 0;
+    }
+    return 1;
+}
+
+
+void HOT_FUNC(handle_nmea_sentence)(char *line, uint16_t len, uint32_t hash) {
+    // called from the RX interrupt for each complete sentence that passed its
+    // checksum, terminator included. `hash` comes from the framer.
+    frame_publish(FRAME_NMEA, 0, 0, (uint8_t *)line, len);
+
+    // decoders work on the fields in place, the sinks already have their copy
+    if (len < 7)
+        return;
+    if (nmea_strncmp(line + 3, "GSV,", 4) == 0) {
+        // GSV groups repeat unchanged for many epochs when nothing moves much. if the
+        // framer's hash says this part is byte for byte the one already in the table,
+        // only the group bookkeeping is done, not the parsing.
+        uint32_t start = time_us_32();
+        char *fields[NMEA_MAX_FIELDS];
+        int hit;
+        int part = nmea_atoi(line + 9 + (line[8] != ','));  // msgNum, after the one or two digit numMsg
+        nmea_cache_t *entry = nmea_cache_lookup(line, part, len, hash, &hit);
+        if (hit && entry->applied) {
+            nmea_split(line, fields, 4);  // just numMsg and msgNum
+            int talker_gnss = gsv_talker(fields[0]);
+            if (talker_gnss >= 0 && gsv_part_start(talker_gnss, part)) {
+                sat_group_seen |= entry->seen;
+                entry->group = sat_group_id;
+                gsv_part_end(talker_gnss, nmea_atoi(fields[1]), part);
+            }
+            gsv_reused++;
+            gsv_reuse_us += time_us_32() - start;
+        } else {
+            int num_fields = nmea_split(line, fields, NMEA_MAX_FIELDS);
+            entry->seen = decode_gsv(fields, num_fields);
+            entry->group = sat_group_id;
+            gsv_decoded++;
+            gsv_decode_us += time_us_32() - start;
+        }
+    } else if (fix_fields() && decode_nmea_fix(line, &nmea_fix, fix_fields())) {
+        nmea_fix.rx_us = rx_time_us();
+        nmea_fix_count++;
+    }
+}
+
+
+nmea_cache_t *HOT_FUNC(nmea_cache_lookup)(const char *line, uint8_t part, uint16_t len, uint32_t hash, int *hit) {
+    // find the cache entry of a GSV part and compare the new
+    // sentence against it by length and hash. the entry is refreshed on a miss, so
+    // it always describes the last sentence of its kind. a collision needs the XOR
+    // and both fletcher sums to agree at the same length.
+    nmea_cache_lookups++;
+    nmea_cache_t *entry = NULL;
+    for (int i = 0; i < NMEA_CACHE_SLOTS; i++) {
+        if (nmea_cache[i].part == part && nmea_strncmp(nmea_cache[i].key, line + 1, 5) == 0) {
+            entry = &nmea_cache[i];
+            break;
+        }
+    }
+    if (entry && entry->len == len && entry->hash == hash) {
+        nmea_cache_hits++;
+        *hit = 1;
+        return entry;
+    }
+    if (!entry) {
+        entry = &nmea_cache[nmea_cache_next];
+        nmea_cache_next = (nmea_cache_next + 1) % NMEA_CACHE_SLOTS;
+        memcpy(entry->key, line + 1, 5);
+        entry->key[5] = '\0';
+        entry->part = part;
+    }
+    entry->len = len;
+    entry->hash = hash;
+    entry->seen = 0;
+    entry->applied = 0;
+    *hit = 0;
+    return entry;
+}
+
+
+int HOT_FUNC(feed_rx_byte)(uint8_t ch) {
+    // one received byte into the framers. UBX goes first, a UBX sync char can't
+    // start an NMEA sentence. returns 1 if the byte was part of a frame.
+    if (ubx_parse_byte(&ubx_rx, ch))
+        return 1;
+    return nmea_parse_byte(&nmea_rx, ch);
+}
+
+
+int HOT_FUNC(sink_accepts)(sink_t *sink, uint8_t type, uint8_t msg_class, uint8_t msg_id) {
+    // apply the sink's message filter, then its decimation
+    if (!sink->enabled)
+        return 0;
+    if (type == FRAME_NMEA) {
+        if (!sink->nmea)
+            return 0;
+    } else {
+        if (sink->ubx_class == FILTER_NONE)
+            return 0;
+        if (sink->ubx_class != FILTER_ANY && sink->ubx_class != msg_class)
+            return 0;
+        if (sink->ubx_id != FILTER_ANY && sink->ubx_id != msg_id)
+            return 0;
+    }
+    if (sink->skip) {
+        sink->skip--;  // counted down so decimate needn't divide the counter's range
+        return 0;
+    }
+    sink->skip = sink->decimate - 1;
+    return 1;
+}
+
+
+void HOT_FUNC(frame_publish)(uint8_t type, uint8_t msg_class, uint8_t msg_id, const uint8_t *data, uint16_t len) {
+    // called from the RX interrupt. the frame is copied once into a pool buffer and
+    // queued by reference on every sink that wants it. a full sink queue or an empty
+    // pool drops the frame for the affected sinks only.
+    sink_t *wanted[NUM_SINKS];
+    int refs = 0;
+    for (int i = 0; i < NUM_SINKS; i++) {
+        sink_t *sink = &sinks[i];
+        if (!sink_accepts(sink, type, msg_class, msg_id))
+            continue;
+        if ((uint8_t)(sink->head - sink->tail) == SINK_QUEUE_LEN) {
+            sink->dropped++;  // this sink is behind, the others carry on
+            continue;
+        }
+        wanted[refs++] = sink;
+    }
+    if (refs == 0)
+        return;
+    if (frame_free_count == 0) {
+        frame_pool_exhausted++;
+        for (int i = 0; i < refs; i++)
+            wanted[i]->dropped++;
+        return;
+    }
+
+    uint8_t idx = frame_free[--frame_free_count];
+    if (frame_free_count < frame_free_min)
+        frame_free_min = frame_free_count;
+    frame_t *frame = &frame_pool[idx];
+    frame->type = type;
+    frame->msg_class = msg_class;
+    frame->msg_id = msg_id;
+    frame->refs = refs;
+    frame->rx_us = rx_time_us();
+    if (type == FRAME_UBX) {
+        frame->len = compile_ubx_msg(frame->data, msg_class, msg_id, data, len);
+    } else {
+        memcpy(frame->data, data, len);
+        frame->len = len;
+    }
+    for (int i = 0; i < refs; i++) {
+        sink_t *sink = wanted[i];
+        sink->queue[sink->head & (SINK_QUEUE_LEN - 1)] = idx;
+        sink->head++;
+        uint8_t backlog = sink->head - sink->tail;
+        if (backlog > sink->max_backlog)
+            sink->max_backlog = backlog;
+    }
+}
+
+
+void frame_release(uint8_t idx) {
+    // drop one reference, the last one returns the buffer to the pool
+    uint32_t ints = save_and_disable_interrupts();
+    if (--frame_pool[idx].refs == 0)
+        frame_free[frame_free_count++] = idx;
+    restore_interrupts(ints);
+}
+
+
+void service_sinks(void) {
+    // called from the main loop. each sink drains its own queue; a busy sink stops
+    // at its first frame and is picked up again on the next pass.
+    for (int i = 0; i < NUM_SINKS; i++) {
+        sink_t *sink = &sinks[i];
+        while (sink->tail != sink->head) {
+            uint8_t idx = sink->queue[sink->tail & (SINK_QUEUE_LEN - 1)];
+            if (!sink->write(&frame_pool[idx]))
+                break;
+            sink->tail++;
+            sink->delivered++;
+            frame_release(idx);
+        }
+    }
+}
+
+
+void print_sink_stats(void) {
+    printf("frame pool: %d/%d free, low watermark %d, exhausted %lu times\n",
+           frame_free_count, FRAME_POOL_SIZE, frame_free_min, (unsigned long)frame_pool_exhausted);
+    for (int i = 0; i < NUM_SINKS; i++) {
+        sink_t *sink = &sinks[i];
+        if (!sink->enabled)
+            continue;
+        printf("sink %s: %lu delivered, %lu dropped, backlog %d (max %d)\n",
+               sink->name, (unsigned long)sink->delivered, (unsigned long)sink->dropped,
+               (uint8_t)(sink->head - sink->tail), sink->max_backlog);
+    }
+}
+
+
+int usb_log_write(const frame_t *frame) {
+    // echo to the USB console, what on_uart_rx() used to do byte by byte. with no
+    // host attached the frame is thrown away instead of waiting on stdio.
+    if (stdio_usb_connected())
+        fwrite(frame->data, 1, frame->len, stdout);
+    return 1;
+}
+
+
+int mavlink_sink_write(const frame_t *frame) {
+    nav_fix_t fix;
+    decode_nav_pvt(frame->data + 6, &fix, FIX_ALL);
+    fix.rx_us = frame->rx_us;  // latency is measured from when the frame arrived
+    return mavlink_send_fix(&fix, mavlink_msg);
+}
+
+
+int HOT_FUNC(nmea_split)(char *line, char **fields, int max_fields) {
+    // split a sentence into its fields in place, without the `$` and the checksum.
+    // unlike strtok() empty fields are kept, they're common in NMEA.
+    int n = 0;
+    char *p = line + 1;
+    fields[n++] = p;
+    for (; *p && *p != '*' && *p != '\r' && *p != '\n'; p++) {
+        if (*p == ',') {
+            *p = '\0';
+            if (n == max_fields)
+                break;
+            fields[n++] = p + 1;
+        }
+    }
+    *p = '\0';
+    return n;
+}
+
+
+int HOT_FUNC(sat_slot)(int talker_gnss, int svid, int *gnss) {
+    // map an NMEA satellite id to the table's gnssId and slot, -1 if it doesn't fit
+    *gnss = talker_gnss;
+    int slot = -1;
+    if (talker_gnss == 0) {  // GP talker also carries SBAS and QZSS
+        if (svid >= 1 && svid <= 32) {
+            slot = svid - 1;
+        } else if (svid >= 33 && svid <= 64) {
+            *gnss = 1;
+            slot = svid - 33;
+        } else if (svid >= 193 && svid <= 202) {
+            *gnss = 5;
+            slot = svid - 193;
+        }
+    } else if (talker_gnss == 6) {
+        slot = svid >= 65 ? svid - 65 : svid - 1;  // GLONASS, 65-96 or 1-32 (NMEA 4.11)
+    } else {
+        slot = svid > 300 ? svid % 100 - 1 : svid - 1;  // Galileo 301-336, BeiDou 401-463 in extended numbering
+    }
+    return slot >= 0 && slot < SAT_SLOTS ? slot : -1;
+}
+
+
+void HOT_FUNC(sat_set)(int gnss, int slot, uint8_t cno, int8_t elev, int16_t azim) {
+    // write one slot of the table and adjust the constellation's summary by the
+    // difference, so nothing is recounted. the caller holds sat_seq odd.
+    sat_summary_t *summary = &sat_summary[gnss];
+    uint8_t old = sat_cno[gnss][slot];
+    if (old) {
+        summary->tracked--;
+        summary->cno_sum -= old;
+        if (old >= SAT_STRONG_CNO)
+            summary->strong--;
+    }
+    if (cno) {
+        summary->tracked++;
+        summary->cno_sum += cno;
+        if (cno >= SAT_STRONG_CNO)
+            summary->strong++;
+    }
+    sat_cno[gnss][slot] = cno;
+    sat_elev[gnss][slot] = elev;
+    sat_azim[gnss][slot] = azim;
+    sat_updates++;
+}
+
+
+void HOT_FUNC(sat_commit)(int gnss, uint64_t seen) {
+    // publish a complete group: apply the pending changes and drop the satellites
+    // that weren't in it. the work is proportional to what changed.
+    sat_seq[gnss]++;  // odd: readers retry
+    __dmb();
+    for (int i = 0; i < sat_pending_count; i++) {
+        sat_change_t *c = &sat_pending[i];
+        sat_set(gnss, c->slot, c->cno, c->elev, c->azim);
+    }
+    uint64_t gone = sat_present[gnss] & ~seen;
+    while (gone) {
+        int slot = __builtin_ctzll(gone);
+        gone &= gone - 1;
+        sat_set(gnss, slot, 0, 0, 0);
+    }
+    sat_present[gnss] = seen;
+    sat_summary[gnss].visible = __builtin_popcountll(seen);
+    __dmb();
+    sat_seq[gnss]++;  // even again: consistent
+    sat_pending_count = 0;
+}
+
+
+int HOT_FUNC(gsv_talker)(const char *talker) {
+    // the table's gnssId for a GSV talker id, -1 for ones that aren't tracked
+    static const char HOT_DATA talkers[][3] = { "GP", "", "GA", "GB", "", "GQ", "GL" };
+    for (int i = 0; i < SAT_GNSS; i++) {
+        if (talkers[i][0] && nmea_strncmp(talker, talkers[i], 2) == 0)
+            return i;
+    }
+    if (nmea_strncmp(talker, "BD", 2) == 0)
+        return 3;
+    return -1;
+}
+
+
+int HOT_FUNC(gsv_part_start)(int talker_gnss, int msg_num) {
+    // group sequencing: part 1 opens a group, the others must follow in order.
+    // returns 0 if the part is out of sequence and the group was dropped.
+    if (msg_num == 1) {
+        sat_group_gnss = talker_gnss;
+        sat_group_next = 1;
+        sat_group_seen = 0;
+        sat_pending_count = 0;
+        sat_group_id++;
+    }
+    if (talker_gnss != sat_group_gnss || msg_num != sat_group_next) {
+        sat_group_gnss = -1;  // out of sequence, wait for the next group
+        return 0;
+    }
+    sat_group_next++;
+    return 1;
+}
+
+
+void HOT_FUNC(gsv_part_end)(int talker_gnss, int num_msg, int msg_num) {
+    // publish the group after its last part. the cached parts that went into it
+    // now match the table, so an identical repeat of them can skip the parsing.
+    // older parts of the constellation don't, the commit may have removed theirs.
+    if (msg_num != num_msg)
+        return;
+    sat_commit(talker_gnss, sat_group_seen);
+    sat_group_gnss = -1;
+    for (int i = 0; i < NMEA_CACHE_SLOTS; i++) {
+        if (nmea_cache[i].part && gsv_talker(nmea_cache[i].key) == talker_gnss)
+            nmea_cache[i].applied = nmea_cache[i].group == sat_group_id;
+    }
+}
+
+
+uint64_t HOT_FUNC(decode_gsv)(char **fields, int num_fields) {
+    // $xxGSV,numMsg,msgNum,numSV,{svid,elv,az,cno}*n[,signalId]. each part is
+    // compared against the table and only differing satellites are queued; the
+    // group is published once its last part arrives. a missing part drops the group.
+    // returns the slots this part reported.
+    int talker_gnss = gsv_talker(fields[0]);
+    if (talker_gnss < 0 || num_fields < 4)
+        return 0;
+    int num_msg = nmea_atoi(fields[1]);
+    int msg_num = nmea_atoi(fields[2]);
+    if (!gsv_part_start(talker_gnss, msg_num))
+        return 0;
+
+    uint64_t part_seen = 0;
+    for (int f = 4; f + 3 < num_fields; f += 4) {
+        if (!fields[f][0])
+            continue;
+        int gnss;
+        int slot = sat_slot(talker_gnss, nmea_atoi(fields[f]), &gnss);
+        if (slot < 0)
+            continue;
+        uint8_t cno = nmea_atoi(fields[f + 3]);
+        int8_t elev = nmea_atoi(fields[f + 1]);
+        int16_t azim = nmea_atoi(fields[f + 2]);
+        sat_reported++;
+        if (gnss != talker_gnss)
+            continue;  // SBAS and QZSS come via NAV-SAT, a GP group only owns GPS
+        part_seen |= 1ULL << slot;
+        if ((sat_present[gnss] >> slot & 1) && sat_cno[gnss][slot] == cno
+            && sat_elev[gnss][slot] == elev && sat_azim[gnss][slot] == azim)
+            continue;  // unchanged
+        if (sat_pending_count < SAT_PENDING_MAX) {
+            sat_change_t *c = &sat_pending[sat_pending_count++];
+            c->slot = slot;
+            c->cno = cno;
+            c->elev = elev;
+            c->azim = azim;
+        }
+    }
+    sat_group_seen |= part_seen;
+    gsv_part_end(talker_gnss, num_msg, msg_num);
+    return part_seen;
+}
+
+
+void HOT_FUNC(decode_nav_sat)(const uint8_t *payload, uint16_t len) {
+    // UBX-NAV-SAT has every constellation in one frame, so it's one group per
+    // constellation, all complete at once
+    int num_svs = payload[5];
+    uint64_t seen[SAT_GNSS] = { 0 };
+    for (int gnss = 0; gnss < SAT_GNSS; gnss++) {
+        sat_pending_count = 0;
+        for (int i = 0; i < num_svs && 8 + 12 * i + 12 <= len; i++) {
+            const uint8_t *sv = payload + 8 + 12 * i;
+            if (sv[0] != gnss)
+                continue;
+            int slot = gnss == 1 ? sv[1] - 120 : sv[1] - 1;  // SBAS PRNs start at 120
+            if (slot < 0 || slot >= SAT_SLOTS)
+                continue;
+            uint8_t cno = sv[2];
+            int8_t elev = (int8_t)sv[3];
+            int16_t azim = (int16_t)(sv[4] | (sv[5] << 8));
+            sat_reported++;
+            seen[gnss] |= 1ULL << slot;
+            if ((sat_present[gnss] >> slot & 1) && sat_cno[gnss][slot] == cno
+                && sat_elev[gnss][slot] == elev && sat_azim[gnss][slot] == azim)
+                continue;
+            if (sat_pending_count < SAT_PENDING_MAX) {
+                sat_change_t *c = &sat_pending[sat_pending_count++];
+                c->slot = slot;
+                c->cno = cno;
+                c->elev = elev;
+                c->azim = azim;
+            }
+        }
+        if (sat_pending_count || seen[gnss] != sat_present[gnss])
+            sat_commit(gnss, seen[gnss]);
+    }
+    sat_group_gnss = -1;  // the pending list was reused
+    for (int i = 0; i < NMEA_CACHE_SLOTS; i++)
+        nmea_cache[i].applied = 0;  // the table no longer comes from the cached GSV parts
+}
+
+
+int sat_snapshot(int gnss, uint8_t *cno, int8_t *elev, int16_t *azim, sat_summary_t *summary) {
+    // copy one constellation as of its last complete group, without stopping the
+    // RX interrupt. returns the number of visible satellites.
+    uint32_t seq;
+    do {
+        seq = sat_seq[gnss];
+        __dmb();
+        memcpy(cno, sat_cno[gnss], SAT_SLOTS);
+        memcpy(elev, sat_elev[gnss], SAT_SLOTS);
+        memcpy(azim, sat_azim[gnss], sizeof(sat_azim[gnss]));
+        *summary = sat_summary[gnss];
+        __dmb();
+    } while ((seq & 1) || seq != sat_seq[gnss]);
+    return summary->visible;
+}
+
+
+void print_sat_stats(void) {
+    uint8_t cno[SAT_SLOTS];
+    int8_t elev[SAT_SLOTS];
+    int16_t azim[SAT_SLOTS];
+    sat_summary_t summary;
+    for (int gnss = 0; gnss < SAT_GNSS; gnss++) {
+        if (!sat_snapshot(gnss, cno, elev, azim, &summary))
+            continue;
+        printf("%s: %d visible, %d tracked, %d >= %d dBHz, mean C/N0 %d dBHz\n",
+               sat_gnss_names[gnss], summary.visible, summary.tracked, summary.strong,
+               SAT_STRONG_CNO, summary.tracked ? summary.cno_sum / summary.tracked : 0);
+    }
+    printf("sat table: %lu slot updates (changes and removals) for %lu reported satellites\n",
+           (unsigned long)sat_updates, (unsigned long)sat_reported);
+}
+
+
+void print_nmea_cache_stats(void) {
+    // hit rate of the unchanged-sentence check, and what it saved on GSV
+    uint32_t hz = clock_get_hz(clk_sys);
+    uint32_t decode_avg = gsv_decoded ? gsv_decode_us / gsv_decoded : 0;
+    uint32_t reuse_avg = gsv_reused ? gsv_reuse_us / gsv_reused : 0;
+    int64_t saved_us = (int64_t)gsv_reused * decode_avg - gsv_reuse_us;
+    printf("nmea cache: %lu of %lu GSV parts unchanged (%lu%%)\n", (unsigned long)nmea_cache_hits,
+           (unsigned long)nmea_cache_lookups,
+           (unsigned long)(nmea_cache_lookups ? 100ULL * nmea_cache_hits / nmea_cache_lookups : 0));
+    printf("GSV: %lu parts decoded at %lu us, %lu reused at %lu us, ~%lld us (%lld cycles) saved\n",
+           (unsigned long)gsv_decoded, (unsigned long)decode_avg, (unsigned long)gsv_reused,
+           (unsigned long)reuse_avg, (long long)saved_us, (long long)saved_us * (hz / 1000000));
+}
+
+
+void replay_gsv_log(void) {
+    // run a recorded log (eg. from a flight) through the GSV decoding and report how
+    // much of it the unchanged-sentence check skipped
+    uint32_t bytes = replay_from_stdin(NULL);
+    printf("replayed %lu bytes\n", (unsigned long)bytes);
+    print_sat_stats();
+    print_nmea_cache_stats();
+}
+
+
+void fix_subscribe(uint8_t fields) {
+    // add to the fields the decoders fill in. there's no unsubscribe, consumers
+    // are set up once at boot.
+    fix_field_mask |= fields;
+}
+
+
+void fix_restore_subscriptions(uint8_t fields) {
+    // put the set back the way it was before a measurement subscribed for itself
+    fix_field_mask = fields;
+}
+
+
+int32_t HOT_FUNC(parse_fixed)(const char *s, int decimals) {
+    // decimal string to an integer scaled by 10^decimals, eg. ("12.5", 3) -> 12500.
+    // extra digits are truncated, missing ones padded.
+    int32_t sign = 1, value = 0;
+    if (*s == '-') {
+        sign = -1;
+        s++;
+    }
+    while (*s >= '0' && *s <= '9')
+        value = value * 10 + (*s++ - '0');
+    if (*s == '.')
+        s++;
+    for (int i = 0; i < decimals; i++) {
+        value *= 10;
+        if (*s >= '0' && *s <= '9')
+            value += *s++ - '0';
+    }
+    return sign * value;
+}
+
+
+int32_t HOT_FUNC(parse_nmea_coord)(const char *s, char hemisphere) {
+    // NMEA (d)ddmm.mmmmm to 1e-7 deg, without going through floats
+    int32_t minutes = parse_fixed(s, 5);  // (d)ddmm scaled by 1e5
+    int32_t deg = minutes / 10000000;
+    minutes -= deg * 10000000;  // mm.mmmmm scaled by 1e5
+    int32_t value = deg * 10000000 + (int32_t)((int64_t)minutes * 5 / 3);  // 1e7 / (60 * 1e5)
+    return hemisphere == 'S' || hemisphere == 'W' ? -value : value;
+}
+
+
+void HOT_FUNC(parse_nmea_time)(const char *s, nav_fix_t *fix) {
+    // hhmmss.ss
+    if (nmea_strlen(s) < 6)
+        return;
+    fix->hour = (s[0] - '0') * 10 + (s[1] - '0');
+    fix->min = (s[2] - '0') * 10 + (s[3] - '0');
+    fix->sec = (s[4] - '0') * 10 + (s[5] - '0');
+    fix->nano = s[6] == '.' ? parse_fixed(s + 6, 9) : 0;
+}
+
+
+int HOT_FUNC(decode_nmea_fix)(char *line, nav_fix_t *fix, uint8_t fields) {
+    // decode GGA, RMC or ZDA into `fix`, only the groups in `fields`. the sentence is
+    // split only as far as the last field needed, so eg. the time alone out of a GGA
+    // costs one field. returns 1 if anything was decoded.
+    char *f[NMEA_MAX_FIELDS];
+    const char *type = line + 3;
+    int last = 0;  // highest field index needed
+    if (nmea_strncmp(type, "GGA,", 4) == 0) {
+        // $xxGGA,time,lat,NS,lon,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation
+        if (fields & FIX_TIME)
+            last = 1;
+        if (fields & FIX_POSITION)
+            last = 5;
+        if (fields & FIX_QUALITY)
+            last = 7;
+        if (fields & FIX_ALTITUDE)
+            last = 11;
+        if (!last || nmea_split(line, f, last + 1) <= last)
+            return 0;
+        if (fields & FIX_TIME)
+            parse_nmea_time(f[1], fix);
+        if (fields & FIX_POSITION) {
+            fix->lat = parse_nmea_coord(f[2], f[3][0]);
+            fix->lon = parse_nmea_coord(f[4], f[5][0]);
+        }
+        if (fields & FIX_QUALITY) {
+            int quality = nmea_atoi(f[6]);
+            fix->fix_type = quality ? 3 : 0;  // GGA doesn't tell 2D from 3D
+            fix->flags = quality ? 0x01 : 0x00;
+            fix->num_sv = nmea_atoi(f[7]);
+        }
+        if (fields & FIX_ALTITUDE) {
+            fix->h_msl = parse_fixed(f[9], 3);
+            fix->height = fix->h_msl + parse_fixed(f[11], 3);
+        }
+        return 1;
+    }
+    if (nmea_strncmp(type, "RMC,", 4) == 0) {
+        // $xxRMC,time,status,lat,NS,lon,EW,spd,cog,date,mv,mvEW,posMode
+        if (fields & FIX_TIME)
+            last = 1;
+        if (fields & FIX_QUALITY)
+            last = 2;
+        if (fields & FIX_POSITION)
+            last = 6;
+        if (fields & FIX_VELOCITY)
+            last = 8;
+        if (fields & FIX_DATE)
+            last = 9;
+        if (!last || nmea_split(line, f, last + 1) <= last)
+            return 0;
+        if (fields & FIX_TIME)
+            parse_nmea_time(f[1], fix);
+        if (fields & FIX_QUALITY)
+            fix->flags = f[2][0] == 'A' ? 0x01 : 0x00;
+        if (fields & FIX_POSITION) {
+            fix->lat = parse_nmea_coord(f[3], f[4][0]);
+            fix->lon = parse_nmea_coord(f[5], f[6][0]);
+        }
+        if (fields & FIX_VELOCITY) {
+            fix->g_speed = (int32_t)((int64_t)parse_fixed(f[7], 3) * 514444 / 1000000);  // knots to mm/s
+            fix->head_mot = parse_fixed(f[8], 5);
+        }
+        if ((fields & FIX_DATE) && nmea_strlen(f[9]) == 6) {
+            fix->day = (f[9][0] - '0') * 10 + (f[9][1] - '0');
+            fix->month = (f[9][2] - '0') * 10 + (f[9][3] - '0');
+            fix->year = 2000 + (f[9][4] - '0') * 10 + (f[9][5] - '0');
+            fix->valid |= 0x01;
+        }
+        return 1;
+    }
+    if (nmea_strncmp(type, "ZDA,", 4) == 0) {
+        // $xxZDA,time,day,month,year,ltzh,ltzn
+        if (fields & FIX_TIME)
+            last = 1;
+        if (fields & FIX_DATE)
+            last = 4;
+        if (!last || nmea_split(line, f, last + 1) <= last)
+            return 0;
+        if (fields & FIX_TIME) {
+            parse_nmea_time(f[1], fix);
+            if (f[1][0])
+                fix->valid |= 0x02;
+        }
+        if ((fields & FIX_DATE) && f[4][0]) {
+            fix->day = nmea_atoi(f[2]);
+            fix->month = nmea_atoi(f[3]);
+            fix->year = nmea_atoi(f[4]);
+            fix->valid |= 0x01;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+
+void benchmark_decoders(void) {
+    // time one epoch (GGA + RMC + ZDA, and a NAV-PVT) through the decoders under
+    // typical subscription sets, against decoding everything
+    static const char *epoch[] = {
+        "$GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B\r\n",
+        "$GPRMC,083559.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*57\r\n",
+        "$GPZDA,082710.00,16,09,2002,00,00*64\r\n",
+    };
+    static const struct {
+        const char *name;
+        uint8_t fields;
+    } sets[] = {
+        { "everything", FIX_ALL },
+        { "time only", FIX_TIME | FIX_DATE },
+        { "lat/lon/fix type", FIX_POSITION | FIX_QUALITY },
+        { "position + velocity", FIX_TIME | FIX_QUALITY | FIX_POSITION | FIX_VELOCITY },
+    };
+    int num_sentences = sizeof(epoch) / sizeof(epoch[0]);
+    int num_sets = sizeof(sets) / sizeof(sets[0]);
+    uint8_t pvt[NAV_PVT_LEN] = { 0 };
+    char line[NMEA_MAX_LEN];
+    nav_fix_t fix;
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint32_t all_nmea = 0, all_pvt = 0;
+
+    for (int s = 0; s < num_sets; s++) {
+        uint32_t start = time_us_32();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            for (int k = 0; k < num_sentences; k++) {
+                strcpy(line, epoch[k]);  // split works in place
+                decode_nmea_fix(line, &fix, sets[s].fields);
+            }
+        }
+        uint32_t nmea_cycles = (time_us_32() - start) * cycles_per_us / BENCH_ITERATIONS;
+        start = time_us_32();
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+            decode_nav_pvt(pvt, &fix, sets[s].fields);
+        uint32_t pvt_cycles = (time_us_32() - start) * cycles_per_us / BENCH_ITERATIONS;
+        if (s == 0) {
+            all_nmea = nmea_cycles;
+            all_pvt = pvt_cycles;
+        }
+        printf("%-20s NMEA %5lu cycles/epoch (%ld saved), NAV-PVT %4lu cycles/epoch (%ld saved)\n",
+               sets[s].name, (unsigned long)nmea_cycles, (long)all_nmea - (long)nmea_cycles,
+               (unsigned long)pvt_cycles, (long)all_pvt - (long)pvt_cycles);
+    }
+}
+
+
+int HOT_FUNC(ubx_is_streamed)(uint8_t msg_class, uint8_t msg_id) {
+    // frames decoded on the fly instead of buffered
+    return msg_class == UBX_CLASS_RXM && (msg_id == UBX_RXM_RAWX || msg_id == UBX_RXM_SFRBX);
+}
+
+
+raw_record_t *HOT_FUNC(raw_claim)(ubx_rx_t *rx, uint8_t msg_id, uint8_t len) {
+    // start a record in the framer's own slot. the UART and DDC framers can be
+    // mid-record at the same time, so neither fills the ring in place. NULL if the
+    // main loop fell behind, the record is then dropped rather than holding up the parser.
+    if ((uint16_t)(raw_head - raw_tail) == RAW_RING_LEN) {
+        raw_dropped++;
+        return NULL;
+    }
+    raw_record_t *rec = &rx->raw_rec;
+    rec->msg_id = msg_id;
+    rec->status = 0;
+    rec->frame = rx->raw_frame;
+    rec->source = rx->source;
+    rec->len = len;
+    return rec;
+}
+
+
+void HOT_FUNC(raw_publish)(raw_record_t *rec) {
+    // copy a filled record to the ring and hand it to the main loop
+    if (!rec)
+        return;
+    if ((uint16_t)(raw_head - raw_tail) == RAW_RING_LEN) {
+        raw_dropped++;
+        return;
+    }
+    memcpy(&raw_ring[raw_head % RAW_RING_LEN], rec, offsetof(raw_record_t, data) + rec->len);
+    __dmb();  // the contents have to land before the index does
+    raw_head++;
+    uint16_t used = raw_head - raw_tail;
+    if (used > raw_ring_peak)
+        raw_ring_peak = used;
+}
+
+
+void HOT_FUNC(raw_stream_byte)(ubx_rx_t *rx, uint8_t ch) {
+    // one payload byte of a streamed frame, at offset rx->idx. RAWX is cut into one
+    // record per measurement block, SFRBX is small and makes a single record.
+    uint16_t offset = rx->idx;
+    raw_bytes++;
+    if (rx->msg_id == UBX_RXM_RAWX) {
+        if (offset < RAWX_HEADER_LEN) {
+            if (offset < RAWX_KEPT)
+                rx->raw_kept[offset] = ch;
+            return;
+        }
+        uint16_t pos = (offset - RAWX_HEADER_LEN) % RAWX_MEAS_LEN;
+        if (pos == 0) {
+            rx->raw_open = raw_claim(rx, UBX_RXM_RAWX, RAWX_KEPT + RAWX_MEAS_LEN);
+            if (rx->raw_open)
+                memcpy(rx->raw_open->data, rx->raw_kept, RAWX_KEPT);
+        }
+        if (rx->raw_open)
+            rx->raw_open->data[RAWX_KEPT + pos] = ch;
+        if (pos == RAWX_MEAS_LEN - 1) {
+            raw_publish(rx->raw_open);
+            rx->raw_open = NULL;
+        }
+    } else {
+        if (offset == 0)
+            rx->raw_open = raw_claim(rx, UBX_RXM_SFRBX, rx->len < RAW_RECORD_MAX ? rx->len : RAW_RECORD_MAX);
+        if (rx->raw_open && offset < RAW_RECORD_MAX)
+            rx->raw_open->data[offset] = ch;
+        if (offset == rx->len - 1) {
+            raw_publish(rx->raw_open);
+            rx->raw_open = NULL;
+        }
+    }
+}
+
+
+void HOT_FUNC(raw_stream_end)(ubx_rx_t *rx, int ok) {
+    // the checksum verdict for the records already handed out, sent after them.
+    // if the ring is full the marker is lost and the main loop assumes the worst.
+    raw_frames++;
+    if (!ok)
+        raw_frames_bad++;
+    rx->raw_open = NULL;  // a truncated block isn't published
+    raw_record_t *marker = raw_claim(rx, RAW_MARKER, 0);
+    if (marker) {
+        marker->status = ok ? RAW_OK : RAW_BAD;
+        raw_publish(marker);
+    }
+}
+
+
+void service_raw_records(void) {
+    // take records as they arrive but only count them once their frame's marker
+    // says the checksum matched. a bad checksum, or a new frame starting without
+    // a marker, retracts everything taken from the frame. the UART and DDC framers
+    // interleave their records, each is followed on its own.
+    while (raw_tail != raw_head) {
+        __dmb();  // the record was written before the index
+        raw_record_t *rec = &raw_ring[raw_tail % RAW_RING_LEN];
+        int src = rec->source;
+        if (raw_epoch_records[src] && rec->frame != raw_epoch_frame[src]) {
+            raw_retracted += raw_epoch_records[src];  // verdict never arrived
+            raw_epoch_records[src] = 0;
+        }
+        raw_epoch_frame[src] = rec->frame;
+        if (rec->msg_id != RAW_MARKER) {
+            raw_epoch_id[src] = rec->msg_id;
+            raw_epoch_records[src]++;  // unconfirmed until the marker
+        } else if (rec->status == RAW_OK) {
+            raw_records += raw_epoch_records[src];
+            if (raw_epoch_id[src] == UBX_RXM_SFRBX)
+                raw_subframes += raw_epoch_records[src];
+            else
+                raw_meas += raw_epoch_records[src];
+            raw_epoch_records[src] = 0;
+        } else {
+            raw_retracted += raw_epoch_records[src];
+            raw_epoch_records[src] = 0;
+        }
+        raw_tail++;
+    }
+}
+
+
+void print_raw_stats(void) {
+    // the ring is all the RAM streaming needs, a buffering parser would need the
+    // largest payload on top of its usual buffer
+    printf("raw: %lu frames (%lu bad), %lu RAWX measurements, %lu SFRBX subframes, %lu retracted, %lu dropped\n",
+           (unsigned long)raw_frames, (unsigned long)raw_frames_bad, (unsigned long)raw_meas,
+           (unsigned long)raw_subframes, (unsigned long)raw_retracted, (unsigned long)raw_dropped);
+    printf("raw: %lu payload bytes, RAM %u bytes (peak %u records of %u bytes), largest payload %u bytes\n",
+           (unsigned long)raw_bytes, (unsigned)(sizeof(raw_ring) + RAW_SOURCES * sizeof(raw_record_t)), raw_ring_peak,
+           (unsigned)sizeof(raw_record_t), raw_largest);
+}
+
+
+uint32_t feed_synthetic_rawx(int num_meas, int corrupt) {
+    // push a RAWX frame through the parser a byte at a time, the way the RX
+    // interrupt would, draining the ring after every measurement like the main
+    // loop would. returns the frame's length.
+    uint8_t header[6] = { UBX_SYNC_CHAR_1, UBX_SYNC_CHAR_2, UBX_CLASS_RXM, UBX_RXM_RAWX };
+    uint16_t len = RAWX_HEADER_LEN + num_meas * RAWX_MEAS_LEN;
+    header[4] = len & 0xFF;
+    header[5] = len >> 8;
+    uint8_t ck_a = 0, ck_b = 0;
+    for (int i = 0; i < 6; i++) {
+        if (i >= 2) {
+            ck_a += header[i];
+            ck_b += ck_a;
+        }
+        ubx_parse_byte(&ubx_rx, header[i]);
+    }
+    for (int i = 0; i < len; i++) {
+        uint8_t ch = i == 11 ? num_meas : i * 7;  // numMeas, then filler
+        ck_a += ch;
+        ck_b += ck_a;
+        ubx_parse_byte(&ubx_rx, ch);
+        if (i >= RAWX_HEADER_LEN && (i - RAWX_HEADER_LEN) % RAWX_MEAS_LEN == RAWX_MEAS_LEN - 1)
+            service_raw_records();
+    }
+    ubx_parse_byte(&ubx_rx, ck_a);
+    ubx_parse_byte(&ubx_rx, corrupt ? ck_b ^ 0xFF : ck_b);
+    service_raw_records();
+    return len + 8;
+}
+
+
+void benchmark_raw_stream(void) {
+    // time the streaming decode of a RAWX frame larger than UBX_MAX_PAYLOAD and
+    // compare it with what a 921600 baud link can deliver. the RX interrupt must
+    // not be running yet.
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint32_t meas = raw_meas, retracted = raw_retracted;
+    uint32_t bytes = 0;
+    uint32_t start = time_us_32();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        bytes += feed_synthetic_rawx(RAW_BENCH_MEAS, 0);
+    uint32_t us = time_us_32() - start;
+    if (us == 0)
+        us = 1;
+    uint32_t bytes_per_s = (uint64_t)bytes * 1000000 / us;
+    printf("RAWX streaming: %lu byte frames, %lu cycles/byte, %lu bytes/s, %lu%% of the CPU at 921600 baud\n",
+           (unsigned long)(bytes / BENCH_ITERATIONS), (unsigned long)((uint64_t)us * cycles_per_us / bytes),
+           (unsigned long)bytes_per_s, (unsigned long)(100ULL * LINK_921600_BPS / bytes_per_s));
+    feed_synthetic_rawx(RAW_BENCH_MEAS, 1);
+    printf("RAWX streaming: %lu measurements confirmed, %lu retracted by the corrupted frame\n",
+           (unsigned long)(raw_meas - meas), (unsigned long)(raw_retracted - retracted));
+    print_raw_stats();
+}
+
+
+int cfg_value_size(uint32_t key) {
+    // bytes of a configuration value, from the size field of its key id
+    static const uint8_t sizes[8] = { 0, 1, 1, 2, 4, 8, 0, 0 };  // bit, U1, U2, U4, U8
+    return sizes[(key >> 28) & 0x07];
+}
+
+
+int wait_for_cfg_ack(uint32_t replies_before, uint8_t msg_class, uint8_t msg_id) {
+    // wait for the ACK-ACK or ACK-NAK of a CFG message. returns 1 if it was
+    // accepted, 0 if rejected, -1 on timeout.
+    uint64_t deadline = time_us_64() + CFG_ACK_TIMEOUT_MS * 1000ULL;
+    while (time_us_64() < deadline) {
+        if (cfg_acks != replies_before && cfg_ack_class == msg_class && cfg_ack_id == msg_id)
+            return cfg_ack_ok;
+        tight_loop_contents();
+    }
+    return -1;
+}
+
+
+void cfg_write(uint8_t msg_class, uint8_t msg_id, const uint8_t *payload, uint16_t len, int testrun) {
+    // one configuration message, counted so the backends can be compared
+    cfg_messages++;
+    cfg_bytes += len + 8;
+    if (cfg_capture) {
+        cfg_capture_len += compile_ubx_msg(cfg_capture + cfg_capture_len, msg_class, msg_id, payload, len);
+        cfg_capture_acks++;
+    } else if (!testrun) {
+        send_ubx_frame(msg_class, msg_id, payload, len);
+    }
+}
+
+
+int probe_cfg_backend(void) {
+    // ask for CFG-RATE-MEAS with a VALGET. Gen9 and later answer it, the M8 NAKs
+    // or ignores it. the answer is kept, the module doesn't change under us.
+    if (cfg_backend != CFG_BACKEND_UNKNOWN)
+        return cfg_backend;
+    uart_rx_setup();
+    uint8_t payload[8] = { 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x21, 0x30 };  // RAM layer, one key
+    uint32_t replies = valget_count;
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_VALGET, payload, sizeof(payload));
+    uint64_t deadline = time_us_64() + CFG_ACK_TIMEOUT_MS * 1000ULL;
+    while (valget_count == replies && time_us_64() < deadline)
+        tight_loop_contents();
+    cfg_backend = valget_count != replies ? CFG_BACKEND_VALSET : CFG_BACKEND_LEGACY;
+    return cfg_backend;
+}
+
+
+int cfg_apply_valset(const cfg_item_t *items, int num_items, uint8_t layers, int testrun) {
+    // pack the items into as few VALSETs as the protocol allows, all layers at once.
+    // more than one message goes in a transaction so the module applies them
+    // together. returns the number of messages that weren't acknowledged.
+    int num_msgs = (num_items + CFG_VALSET_MAX_ITEMS - 1) / CFG_VALSET_MAX_ITEMS;
+    int failed = 0;
+    for (int m = 0; m < num_msgs; m++) {
+        uint16_t len = 4;
+        cfg_payload[0] = num_msgs > 1 ? 0x01 : 0x00;  // version 1 has the transaction field
+        cfg_payload[1] = layers;
+        cfg_payload[2] = num_msgs == 1 ? 0 : m == 0 ? 1 : m == num_msgs - 1 ? 3 : 2;  // none, begin, continue, apply
+        cfg_payload[3] = 0x00;
+        for (int i = m * CFG_VALSET_MAX_ITEMS; i < num_items && i < (m + 1) * CFG_VALSET_MAX_ITEMS; i++) {
+            int size = cfg_value_size(items[i].key);
+            for (int b = 0; b < 4; b++)
+                cfg_payload[len++] = items[i].key >> (8 * b);
+            for (int b = 0; b < size; b++)
+                cfg_payload[len++] = b < 4 ? items[i].value >> (8 * b) : 0;
+        }
+        uint32_t replies = cfg_acks;
+        cfg_write(UBX_CLASS_CFG, UBX_CFG_VALSET, cfg_payload, len, testrun);
+        if (!testrun && wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_VALSET) != 1)
+            failed++;
+    }
+    return failed;
+}
+
+
+int cfg_verify_valget(const cfg_item_t *items, int num_items) {
+    // read the items back from the RAM layer. returns the number that differ, or
+    // -1 if the module didn't answer.
+    int mismatches = 0;
+    for (int first = 0; first < num_items; first += CFG_VALSET_MAX_ITEMS) {
+        int count = num_items - first < CFG_VALSET_MAX_ITEMS ? num_items - first : CFG_VALSET_MAX_ITEMS;
+        uint8_t request[4 + CFG_VALSET_MAX_ITEMS * 4] = { 0x00, 0x00, 0x00, 0x00 };  // RAM layer, position 0
+        for (int i = 0; i < count; i++) {
+            for (int b = 0; b < 4; b++)
+                request[4 + 4 * i + b] = items[first + i].key >> (8 * b);
+        }
+        uint32_t replies = valget_count;
+        send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_VALGET, request, 4 + 4 * count);
+        uint64_t deadline = time_us_64() + CFG_ACK_TIMEOUT_MS * 1000ULL;
+        while (valget_count == replies) {
+            if (time_us_64() > deadline)
+                return -1;
+            tight_loop_contents();
+        }
+        // the reply has the keys in request order, each followed by its value
+        uint16_t pos = 4;
+        for (int i = 0; i < count; i++) {
+            if (pos + 4 > valget_len || ubx_u32(&cfg_payload[pos]) != items[first + i].key) {
+                mismatches++;
+                continue;
+            }
+            int size = cfg_value_size(items[first + i].key);
+            uint32_t value = 0;
+            for (int b = 0; b < size && b < 4; b++)
+                value |= (uint32_t)cfg_payload[pos + 4 + b] << (8 * b);
+            if (value != items[first + i].value)
+                mismatches++;
+            pos += 4 + size;
+        }
+    }
+    return mismatches;
+}
+
+
+int cfg_apply_legacy(const cfg_item_t *items, int num_items, uint8_t layers, int testrun) {
+    // one message per item into RAM, then a CFG-CFG to save it to the other layers.
+    // PUBX,40 has no acknowledgement. returns the number of UBX messages that
+    // weren't acknowledged.
+    int failed = 0;
+    for (int i = 0; i < num_items; i++) {
+        const cfg_item_t *item = &items[i];
+        uint32_t replies = cfg_acks;
+        if (item->legacy == CFG_LEGACY_NMEA) {
+            char raw_msg[32];
+            char nmea_msg[40];
+            sprintf(raw_msg, "$PUBX,40,%s,0,%d,0,0*", item->nmea, (int)item->value);
+            sprintf(nmea_msg, "%s%02X\r\n", raw_msg, get_checksum(raw_msg));
+            cfg_write_raw((uint8_t *)nmea_msg, strlen(nmea_msg), testrun);
+        } else if (item->legacy == CFG_LEGACY_MSG) {
+            uint8_t payload[3] = { item->msg_class, item->msg_id, item->value };
+            cfg_write(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload), testrun);
+            if (!testrun && wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_MSG) != 1)
+                failed++;
+        } else if (item->legacy == CFG_LEGACY_RATE) {
+            uint8_t payload[6] = { item->value & 0xFF, item->value >> 8, 0x01, 0x00, 0x01, 0x00 };
+            cfg_write(UBX_CLASS_CFG, UBX_CFG_RATE, payload, sizeof(payload), testrun);
+            if (!testrun && wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_RATE) != 1)
+                failed++;
+        }
+    }
+    if (layers & (CFG_LAYER_BBR | CFG_LAYER_FLASH)) {
+        // saveMask for everything, deviceMask: devBBR, devFlash and devSpiFlash
+        uint8_t payload[13] = { 0, 0, 0, 0, 0xFF, 0xFF, 0x00, 0x00, 0, 0, 0, 0, 0 };
+        payload[12] = (layers & CFG_LAYER_BBR ? 0x01 : 0) | (layers & CFG_LAYER_FLASH ? 0x12 : 0);
+        uint32_t replies = cfg_acks;
+        cfg_write(UBX_CLASS_CFG, UBX_CFG_CFG, payload, sizeof(payload), testrun);
+        if (!testrun && wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_CFG) != 1)
+            failed++;
+    }
+    return failed;
+}
+
+
+int apply_profile(const cfg_item_t *items, int num_items, uint8_t layers, int testrun) {
+    // configure the module from a list of key-value items with whichever backend
+    // it supports. returns the number of messages that weren't acknowledged.
+    int backend = testrun ? CFG_BACKEND_LEGACY : probe_cfg_backend();
+    uint32_t messages = cfg_messages, bytes = cfg_bytes;
+    uint64_t start = time_us_64();
+    int failed = backend == CFG_BACKEND_VALSET ? cfg_apply_valset(items, num_items, layers, testrun)
+                                               : cfg_apply_legacy(items, num_items, layers, testrun);
+    if (!testrun)
+        uart_tx_wait_blocking(UART_ID);
+    uint32_t us = time_us_64() - start;
+    printf("profile: %d items via %s, %lu messages, %lu bytes, %lu us, %d not acknowledged\n", num_items,
+           backend == CFG_BACKEND_VALSET ? "VALSET" : "legacy messages", (unsigned long)(cfg_messages - messages),
+           (unsigned long)(cfg_bytes - bytes), (unsigned long)us, failed);
+    if (backend == CFG_BACKEND_VALSET && !testrun)
+        printf("profile: %d items differ on read back\n", cfg_verify_valget(items, num_items));
+    return failed;
+}
+
+
+void compare_config_backends(int testrun) {
+    // message count and link time of both backends for the same profile, then the
+    // real thing with the one the module supports
+    int num_items = sizeof(cfg_profile) / sizeof(cfg_profile[0]);
+    uint8_t layers = CFG_LAYER_RAM | CFG_LAYER_BBR;
+    uint32_t messages = cfg_messages, bytes = cfg_bytes;
+    cfg_apply_legacy(cfg_profile, num_items, layers, 1);
+    uint32_t legacy_msgs = cfg_messages - messages, legacy_bytes = cfg_bytes - bytes;
+    messages = cfg_messages;
+    bytes = cfg_bytes;
+    cfg_apply_valset(cfg_profile, num_items, layers, 1);
+    uint32_t valset_msgs = cfg_messages - messages, valset_bytes = cfg_bytes - bytes;
+    printf("legacy: %lu messages, %lu bytes, %lu us on the wire\n", (unsigned long)legacy_msgs,
+           (unsigned long)legacy_bytes, (unsigned long)(legacy_bytes * 10000000ULL / current_baud));
+    printf("VALSET: %lu messages, %lu bytes, %lu us on the wire\n", (unsigned long)valset_msgs,
+           (unsigned long)valset_bytes, (unsigned long)(valset_bytes * 10000000ULL / current_baud));
+    apply_profile(cfg_profile, num_items, layers, testrun);
+}
+
+
+int apply_power_profile(const pm_profile_t *profile, int testrun) {
+    // UBX-CFG-PM2 with the cycle, then UBX-CFG-RXM to enter (or leave) power save.
+    // the PM2 settings only take effect in power save mode. returns the number of
+    // messages that weren't acknowledged.
+    uint8_t pm2[44] = { 0 };
+    pm2[0] = 0x01;  // message version
+    uint32_t flags = (1 << 11) | (1 << 12);  // updateRTC, updateEPH: keep the aiding fresh while asleep
+    flags |= (uint32_t)profile->mode << 17;
+    for (int b = 0; b < 4; b++) {
+        pm2[4 + b] = flags >> (8 * b);
+        pm2[8 + b] = profile->update_ms >> (8 * b);
+        pm2[12 + b] = profile->search_ms >> (8 * b);
+    }
+    pm2[20] = profile->on_time_s & 0xFF;
+    pm2[21] = profile->on_time_s >> 8;
+    uint8_t rxm[2] = { 0x08, profile->lp_mode };  // reserved1 must be 8
+    if (testrun) {
+        printf("would apply power profile \"%s\"\n", profile->name);
+        return 0;
+    }
+    uart_rx_setup();  // for the ACKs
+    int failed = 0;
+    uint32_t replies = cfg_acks;
+    cfg_write(UBX_CLASS_CFG, UBX_CFG_PM2, pm2, sizeof(pm2), testrun);
+    if (wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_PM2) != 1)
+        failed++;
+    replies = cfg_acks;
+    cfg_write(UBX_CLASS_CFG, UBX_CFG_RXM, rxm, sizeof(rxm), testrun);
+    if (wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_RXM) != 1)
+        failed++;
+    printf("power profile \"%s\": %d not acknowledged\n", profile->name, failed);
+    return failed;
+}
+
+
+int pm_keeps(const pm_profile_t *profile, pm_stats_t *stats, uint32_t itow) {
+    // would the module have output this epoch of a continuous log under the profile?
+    // cyclic tracking gives the first epoch of each update period, ON/OFF the epochs
+    // of the on time after reacquiring.
+    if (!profile->lp_mode)
+        return 1;
+    uint32_t period = itow / profile->update_ms;
+    uint32_t phase = itow % profile->update_ms;
+    if (profile->mode == PM2_ONOFF)
+        return phase >= PM_REACQUIRE_MS && phase < profile->on_time_s * 1000 + PM_REACQUIRE_MS;
+    if (stats->epochs && period == stats->last_period)
+        return 0;
+    stats->last_period = period;
+    return 1;
+}
+
+
+void pm_add_epoch(pm_stats_t *stats, const nav_fix_t *fix) {
+    stats->epochs++;
+    if (fix->fix_type < 2 || !(fix->flags & 0x01))
+        return;
+    if (stats->fixes) {
+        uint32_t gap = fix->itow - stats->last_itow;
+        if (fix->itow < stats->last_itow)
+            gap += 604800000;  // week rollover
+        stats->gaps++;
+        stats->gap_sum_ms += gap;
+        if (gap > stats->max_gap_ms)
+            stats->max_gap_ms = gap;
+    }
+    stats->fixes++;
+    stats->h_acc_sum += fix->h_acc;
+    stats->last_itow = fix->itow;
+}
+
+
+void power_profile_fix(const nav_fix_t *fix) {
+    // one epoch of the replayed log, into every profile that would have produced it
+    pm_add_epoch(&pm_recorded, fix);
+    for (unsigned p = 0; p < PM_PROFILES; p++) {
+        if (pm_keeps(&pm_profiles[p], &pm_stats[p], fix->itow))
+            pm_add_epoch(&pm_stats[p], fix);
+    }
+}
+
+
+void print_pm_stats(const char *name, const pm_stats_t *stats) {
+    printf("%-24s %6lu epochs, %5.1f%% with a fix, fix every %5lu ms (worst %6lu ms), mean hAcc %5lu mm\n",
+           name, (unsigned long)stats->epochs, stats->epochs ? 100.0 * stats->fixes / stats->epochs : 0.0,
+           (unsigned long)(stats->gaps ? stats->gap_sum_ms / stats->gaps : 0), (unsigned long)stats->max_gap_ms,
+           (unsigned long)(stats->fixes ? stats->h_acc_sum / stats->fixes : 0));
+}
+
+
+void measure_power_profiles(void) {
+    // replay a log over USB and report fix availability, the time between fixes and
+    // the accuracy for each power profile. "as recorded" is the log itself, so a log
+    // recorded in power save measures that setting for real. the others are simulated
+    // by thinning a continuous log, which can't show the accuracy lost to sleeping:
+    // record one log per setting for that.
+    memset(pm_stats, 0, sizeof(pm_stats));
+    memset(&pm_recorded, 0, sizeof(pm_recorded));
+    uint8_t fields = fix_field_mask;
+    fix_subscribe(FIX_TIME | FIX_QUALITY | FIX_ACCURACY);
+    uint32_t bytes = replay_from_stdin(power_profile_fix);
+    fix_restore_subscriptions(fields);
+    printf("replayed %lu bytes\n", (unsigned long)bytes);
+    print_pm_stats("as recorded", &pm_recorded);
+    for (unsigned p = 0; p < PM_PROFILES; p++)
+        print_pm_stats(pm_profiles[p].name, &pm_stats[p]);
+}
+
+
+void geofence_prepare(void) {
+    // per fence constants for the pico side check: the longitude scale at the
+    // fence's latitude and the radius squared, both in 1e-7 deg
+    for (unsigned i = 0; i < NUM_GEOFENCES && i < GEOFENCE_MAX; i++) {
+        geofence_lon_q16[i] = cosf(geofences[i].lat * 1e-7f * (float)M_PI / 180.0f) * 65536.0f;
+        int64_t r = geofences[i].radius_cm / CM_PER_1E7_DEG;
+        geofence_r2[i] = r * r;
+    }
+}
+
+
+int configure_geofences(int testrun) {
+    // UBX-CFG-GEOFENCE with `geofences`, the combined state driven on
+    // GEOFENCE_MODULE_PIO (low = inside), and an interrupt on both edges of it at
+    // our end. from then on the pico only hears about the fences when the state
+    // changes, not every epoch. returns 0 if the module took the configuration.
+    uint8_t payload[8 + 12 * GEOFENCE_MAX] = { 0 };
+    int num_fences = NUM_GEOFENCES < GEOFENCE_MAX ? NUM_GEOFENCES : GEOFENCE_MAX;
+    payload[1] = num_fences;
+    payload[2] = GEOFENCE_CONF_LEVEL;
+    payload[4] = 1;  // pioEnabled
+    payload[5] = 0;  // pinPolarity: low means inside
+    payload[6] = GEOFENCE_MODULE_PIO;
+    for (int i = 0; i < num_fences; i++) {
+        for (int b = 0; b < 4; b++) {
+            payload[8 + 12 * i + b] = geofences[i].lat >> (8 * b);
+            payload[12 + 12 * i + b] = geofences[i].lon >> (8 * b);
+            payload[16 + 12 * i + b] = geofences[i].radius_cm >> (8 * b);
+        }
+    }
+    geofence_prepare();
+    if (testrun) {
+        printf("would configure %d geofences\n", num_fences);
+        return 0;
+    }
+    uart_rx_setup();
+    uint32_t replies = cfg_acks;
+    cfg_write(UBX_CLASS_CFG, UBX_CFG_GEOFENCE, payload, 8 + 12 * num_fences, testrun);
+    int acked = wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_GEOFENCE) == 1;
+    printf("geofences: %d configured, %s\n", num_fences, acked ? "acknowledged" : "not acknowledged");
+
+    gpio_init(GEOFENCE_WAKE_PIN);
+    gpio_set_dir(GEOFENCE_WAKE_PIN, GPIO_IN);
+    gpio_set_irq_enabled_with_callback(GEOFENCE_WAKE_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL,
+                                       true, gpio_event);
+    request_geofence_state();  // the starting state, the pin only reports changes
+    return !acked;
+}
+
+
+void gpio_event(uint gpio, uint32_t events) {
+    // the SDK keeps one GPIO callback per core, this passes the events on
+    if (gpio == GEOFENCE_WAKE_PIN)
+        geofence_pin_changed(gpio, events);
+    else if (gpio == TXREADY_PIN)
+        txready_pin_changed();
+}
+
+
+void geofence_pin_changed(uint gpio, uint32_t events) {
+    // GPIO interrupt: just note it, the main loop asks the module for the details
+    geofence_edges++;
+}
+
+
+void request_geofence_state(void) {
+    // poll UBX-NAV-GEOFENCE, the reply is picked up by handle_ubx_frame()
+    send_ubx_frame(UBX_CLASS_NAV, UBX_NAV_GEOFENCE, NULL, 0);
+    geofence_link_bytes += 8;
+}
+
+
+int geofence_check_pico(const nav_fix_t *fix) {
+    // the same check done here on every NAV-PVT, for comparison: 1 if the fix is
+    // inside any fence, 2 if outside all, like combState. flat earth within a
+    // fence, fine for fences up to a few km. unlike the module it ignores hAcc.
+    for (unsigned i = 0; i < NUM_GEOFENCES && i < GEOFENCE_MAX; i++) {
+        int64_t dlat = fix->lat - geofences[i].lat;
+        int64_t dlon = ((int64_t)(fix->lon - geofences[i].lon) * geofence_lon_q16[i]) >> 16;
+        if (dlat * dlat + dlon * dlon <= geofence_r2[i])
+            return 1;
+    }
+    return 2;
+}
+
+
+void compare_geofence_cost(void) {
+    // pico CPU and link traffic of checking the fences on the pico every epoch
+    // (NAV-PVT streamed and decoded, then the check) against the module doing it
+    // (nothing per epoch, a poll and a NAV-GEOFENCE per state change). the frames go
+    // through a parser of their own, nothing reaches last_fix or the sinks, so the
+    // receive figure leaves out what the sinks cost.
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint8_t pvt[NAV_PVT_LEN] = { 0 };
+    uint8_t frame[NAV_PVT_LEN + 8];
+    size_t frame_len = compile_ubx_msg(frame, UBX_CLASS_NAV, UBX_NAV_PVT, pvt, NAV_PVT_LEN);
+    nav_fix_t fix = { 0 };
+    static ubx_rx_t rx;  // too big for the stack
+    memset(&rx, 0, sizeof(rx));
+    rx.frames_only = 1;
+    geofence_prepare();
+    uint32_t start = time_us_32();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (size_t k = 0; k < frame_len; k++)
+            ubx_parse_byte(&rx, frame[k]);  // framing, as in the RX interrupt
+        decode_nav_pvt(rx.payload, &fix, FIX_QUALITY | FIX_POSITION);
+    }
+    uint32_t rx_cycles = (time_us_32() - start) * cycles_per_us / BENCH_ITERATIONS;
+    volatile int inside = 0;  // keep the loop from being optimized away
+    start = time_us_32();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fix.lat = geofences[0].lat + i * 100;  // walk out through the first fence
+        fix.lon = geofences[0].lon;
+        inside += geofence_check_pico(&fix) == 1;
+    }
+    uint32_t check_cycles = (time_us_32() - start) * cycles_per_us / BENCH_ITERATIONS;
+    uint32_t epochs_per_s = 1000 / nav_period_ms;
+    printf("geofence on the pico: %lu cycles/epoch (receive %lu, check %lu), %lu cycles/s, %lu bytes/s at %u ms\n",
+           (unsigned long)(rx_cycles + check_cycles), (unsigned long)rx_cycles, (unsigned long)check_cycles,
+           (unsigned long)((rx_cycles + check_cycles) * epochs_per_s), (unsigned long)(frame_len * epochs_per_s),
+           nav_period_ms);
+    printf("geofence on the module: 0 cycles/epoch, 0 bytes/s; %d bytes and one GPIO interrupt per state change\n",
+           8 + 8 + 8 + 2 * (int)NUM_GEOFENCES);
+}
+
+
+void print_geofence_stats(void) {
+    static const char *states[] = { "unknown", "inside", "outside" };
+    printf("geofence: %s, combined %s, %lu pin changes, %lu replies, %lu bytes on the link\n",
+           geofence_status ? "active" : "not available", states[geofence_comb_state < 3 ? geofence_comb_state : 0],
+           (unsigned long)geofence_edges, (unsigned long)geofence_replies, (unsigned long)geofence_link_bytes);
+}
+
+
+void cfg_write_raw(const uint8_t *data, size_t len, int testrun) {
+    // an already built message, eg. a PUBX sentence, counted like cfg_write()
+    cfg_messages++;
+    cfg_bytes += len;
+    if (cfg_capture) {
+        memcpy(cfg_capture + cfg_capture_len, data, len);
+        cfg_capture_len += len;
+    } else if (!testrun) {
+        uart_write_blocking(UART_ID, data, len);
+    }
+}
+
+
+int profile_delta(const mission_profile_t *from, const mission_profile_t *to, cfg_item_t *delta) {
+    // the items of `to` that `from` doesn't set to the same value. `from` NULL
+    // means the module's state is unknown and everything is sent.
+    int n = 0;
+    for (int i = 0; i < to->num_items && n < PROFILE_MAX_ITEMS; i++) {
+        int same = 0;
+        for (int k = 0; from && k < from->num_items; k++) {
+            if (from->items[k].key == to->items[i].key)
+                same = from->items[k].value == to->items[i].value;
+        }
+        if (!same)
+            delta[n++] = to->items[i];
+    }
+    return n;
+}
+
+
+uint32_t profile_hash(int backend) {
+    // FNV-1a over everything the transitions are built from, so a changed profile
+    // table (or a different module) rebuilds them
+    uint32_t hash = 2166136261u ^ backend;
+    for (int p = 0; p < NUM_MISSION_PROFILES; p++) {
+        for (int i = 0; i < mission_profiles[p].num_items; i++) {
+            const cfg_item_t *item = &mission_profiles[p].items[i];
+            uint32_t words[3] = { item->key, item->value, item->legacy | item->msg_class << 8 | item->msg_id << 16 };
+            for (int w = 0; w < 3; w++) {
+                for (int b = 0; b < 4; b++)
+                    hash = (hash ^ ((words[w] >> (8 * b)) & 0xFF)) * 16777619u;
+            }
+        }
+        hash = (hash ^ p) * 16777619u;
+    }
+    return hash;
+}
+
+
+int prepare_transitions(int testrun) {
+    // build the frames for every (from, to) pair of mission profiles with the
+    // module's backend and keep them in flash. only rebuilt when the profiles or
+    // the backend changed. returns 0 if usable transitions are in flash.
+    int backend = testrun ? CFG_BACKEND_LEGACY : probe_cfg_backend();
+    uint32_t hash = profile_hash(backend);
+    const transition_header_t *stored = (const transition_header_t *)(XIP_BASE + TRANSITION_FLASH_OFFSET);
+    if (stored->magic == TRANSITION_MAGIC && stored->hash == hash && stored->num_profiles == NUM_MISSION_PROFILES)
+        return 0;
+    if (NUM_MISSION_PROFILES > MAX_PROFILES)
+        return -1;
+
+    // nav_db is only used while the navigation database is saved or restored,
+    // borrow it to assemble the image
+    uint8_t *image = nav_db;
+    transition_header_t *header = (transition_header_t *)image;
+    memset(header, 0, sizeof(*header));
+    header->magic = TRANSITION_MAGIC;
+    header->hash = hash;
+    header->num_profiles = NUM_MISSION_PROFILES;
+    cfg_capture = image;
+    cfg_capture_len = sizeof(*header);
+    cfg_item_t delta[PROFILE_MAX_ITEMS];
+    for (int from = 0; from <= NUM_MISSION_PROFILES; from++) {
+        for (int to = 0; to < NUM_MISSION_PROFILES; to++) {
+            transition_t *t = &header->table[from * NUM_MISSION_PROFILES + to];
+            if (cfg_capture_len + PROFILE_MAX_ITEMS * 48 > TRANSITION_FLASH_SIZE) {
+                cfg_capture = NULL;
+                printf("profile transitions don't fit in %u bytes\n", TRANSITION_FLASH_SIZE);
+                return -1;
+            }
+            int n = profile_delta(from < NUM_MISSION_PROFILES ? &mission_profiles[from] : NULL,
+                                  &mission_profiles[to], delta);
+            uint32_t messages = cfg_messages;
+            cfg_capture_acks = 0;
+            t->offset = cfg_capture_len;
+            if (n && backend == CFG_BACKEND_VALSET)
+                cfg_apply_valset(delta, n, CFG_LAYER_RAM, 1);
+            else if (n)
+                cfg_apply_legacy(delta, n, CFG_LAYER_RAM, 1);
+            t->len = cfg_capture_len - t->offset;
+            t->acks = cfg_capture_acks;
+            t->messages = cfg_messages - messages;
+        }
+    }
+    cfg_capture = NULL;
+    header->len = cfg_capture_len;
+    printf("profile transitions: %d profiles, %u bytes\n", NUM_MISSION_PROFILES, header->len);
+    if (testrun) {
+        printf("would save them to flash at 0x%X\n", TRANSITION_FLASH_OFFSET);
+        return -1;
+    }
+    uint32_t program_len = (header->len + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(TRANSITION_FLASH_OFFSET, TRANSITION_FLASH_SIZE);
+    flash_range_program(TRANSITION_FLASH_OFFSET, image, program_len);
+    restore_interrupts(ints);
+    nav_db_len = sizeof(nav_db_header_t);  // give it back empty
+    return 0;
+}
+
+
+int switch_profile(int to, int testrun) {
+    // switch the module to mission_profiles[to] with one burst of the prebuilt
+    // frames from flash, then wait for all their ACKs. the time until the last ACK
+    // is the switch latency. returns the number of frames not acknowledged.
+    const transition_header_t *header = (const transition_header_t *)(XIP_BASE + TRANSITION_FLASH_OFFSET);
+    int from = current_profile < 0 ? NUM_MISSION_PROFILES : current_profile;
+    const transition_t *t = &header->table[from * NUM_MISSION_PROFILES + to];
+    if (header->magic != TRANSITION_MAGIC || header->num_profiles != NUM_MISSION_PROFILES) {
+        printf("no profile transitions in flash\n");
+        return -1;
+    }
+    if (testrun) {
+        printf("would switch to \"%s\": %u messages, %u bytes\n", mission_profiles[to].name, t->messages, t->len);
+        return 0;
+    }
+    uart_rx_setup();
+    uint32_t acks = cfg_acks;
+    uint64_t start = time_us_64();
+    uart_write_blocking(UART_ID, (const uint8_t *)header + t->offset, t->len);  // pipelined, no waiting in between
+    uint64_t sent = time_us_64();
+    uint64_t deadline = sent + CFG_ACK_TIMEOUT_MS * 1000ULL;
+    while (cfg_acks - acks < t->acks && time_us_64() < deadline)
+        tight_loop_contents();
+    int missing = t->acks - (int)(cfg_acks - acks);
+    if (missing < 0)
+        missing = 0;
+    printf("switched to \"%s\": %u messages, %u bytes, sent in %llu us, acknowledged in %llu us%s\n",
+           mission_profiles[to].name, t->messages, t->len, sent - start, time_us_64() - start,
+           missing ? " (ACKs missing)" : "");
+    current_profile = to;
+    for (int i = 0; i < mission_profiles[to].num_items; i++) {
+        if (mission_profiles[to].items[i].key == 0x30210001)  // CFG-RATE-MEAS, as set_nav_rate() would
+            nav_period_ms = mission_profiles[to].items[i].value;
+    }
+    return missing;
+}
+
+
+void demo_profile_switching(int testrun) {
+    // build the transitions, then go round the profiles. the first switch sends
+    // the full profile, the others only what differs.
+    if (prepare_transitions(testrun) != 0 && !testrun)
+        return;
+    for (int i = 0; i <= NUM_MISSION_PROFILES; i++)
+        switch_profile(i % NUM_MISSION_PROFILES, testrun);
+}
+
+
+int journal_latest(journal_record_t *rec) {
+    // the newest record that's intact. a write torn by a power loss fails its CRC
+    // and the one before it counts. returns its slot, or -1 if there's none.
+    int latest = -1;
+    for (int slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        const journal_record_t *r = (const journal_record_t *)(XIP_BASE + JOURNAL_FLASH_OFFSET + slot * FLASH_PAGE_SIZE);
+        if (r->magic != JOURNAL_MAGIC || r->crc != crc_x25((const uint8_t *)r, offsetof(journal_record_t, crc), 0xFFFF))
+            continue;
+        if (latest < 0 || (int32_t)(r->seq - rec->seq) > 0) {
+            *rec = *r;
+            latest = slot;
+        }
+    }
+    return latest;
+}
+
+
+int journal_slot_erased(int slot) {
+    const uint8_t *p = (const uint8_t *)(XIP_BASE + JOURNAL_FLASH_OFFSET + slot * FLASH_PAGE_SIZE);
+    for (int i = 0; i < FLASH_PAGE_SIZE; i++) {
+        if (p[i] != 0xFF)
+            return 0;
+    }
+    return 1;
+}
+
+
+void journal_append(journal_record_t *rec) {
+    // write `rec` to the slot after the current one. entering a sector erases it
+    // first; the current record is in the other sector then, so it survives.
+    // programming only clears bits, so slots holding a torn write (which never
+    // became current) are skipped, at worst up to the next sector, which is erased.
+    journal_record_t last;
+    int current = journal_latest(&last);
+    int slot = (current + 1) % JOURNAL_SLOTS;
+    while ((slot * FLASH_PAGE_SIZE) % FLASH_SECTOR_SIZE != 0 && !journal_slot_erased(slot))
+        slot = (slot + 1) % JOURNAL_SLOTS;
+    rec->magic = JOURNAL_MAGIC;
+    rec->seq = current < 0 ? 1 : last.seq + 1;
+    rec->crc = crc_x25((const uint8_t *)rec, offsetof(journal_record_t, crc), 0xFFFF);
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, rec, sizeof(*rec));
+    uint32_t offset = JOURNAL_FLASH_OFFSET + slot * FLASH_PAGE_SIZE;
+    uint32_t ints = save_and_disable_interrupts();
+    if (offset % FLASH_SECTOR_SIZE == 0)
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    flash_range_program(offset, page, FLASH_PAGE_SIZE);
+    restore_interrupts(ints);
+}
+
+
+uint32_t journal_txn_hash(void) {
+    // FNV-1a of what the journaled configuration consists of
+    uint32_t hash = 2166136261u;
+    for (unsigned i = 0; i < sizeof(cfg_profile) / sizeof(cfg_profile[0]); i++) {
+        uint32_t words[2] = { cfg_profile[i].key, cfg_profile[i].value };
+        for (int w = 0; w < 2; w++) {
+            for (int b = 0; b < 4; b++)
+                hash = (hash ^ ((words[w] >> (8 * b)) & 0xFF)) * 16777619u;
+        }
+    }
+    return (hash ^ JOURNAL_TARGET_BAUD) * 16777619u;
+}
+
+
+int module_responds(int baud) {
+    // switch the pico to `baud` and poll CFG-RATE. any ACK or NAK means the module
+    // is listening at that baud.
+    uart_set_baudrate(UART_ID, baud);
+    current_baud = baud;
+    busy_wait_ms(5);  // let a partial frame at the old baud drain
+    uint32_t replies = cfg_acks;
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_RATE, NULL, 0);
+    return wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_RATE) >= 0;
+}
+
+
+int journal_apply(int testrun) {
+    // apply cfg_profile, then JOURNAL_TARGET_BAUD, then save it to BBR, one step at
+    // a time. every acknowledged step is journaled before the next one starts, so
+    // after a power loss (of either side) this picks up at the first step that
+    // didn't complete, at the right baud. returns the number of the step that
+    // failed, or -1 if everything is applied.
+    int num_items = sizeof(cfg_profile) / sizeof(cfg_profile[0]);
+    int baud_step = num_items;
+    int save_step = num_items + 1;
+    journal_record_t rec;
+    uint32_t txn = journal_txn_hash();
+    int have = journal_latest(&rec) >= 0 && rec.txn == txn;
+    if (testrun) {
+        printf("would %s the journaled configuration (%d steps)\n",
+               have ? "resume" : "apply", save_step + 1);
+        return -1;
+    }
+    uart_rx_setup();
+    uint64_t start = time_us_64();
+
+    int resume = 0;
+    if (have) {
+        // find the module where the journal says it is. a baud change in flight
+        // could have gone either way. if it only answers at the default, it lost
+        // its configuration (no backup supply): start over.
+        int baud = rec.pending_baud ? rec.pending_baud : rec.baud;
+        if (module_responds(baud)) {
+            resume = 1;
+            if (rec.pending_baud)
+                rec.step = baud_step + 1;  // the change went through
+        } else if (rec.pending_baud && module_responds(rec.baud)) {
+            resume = 1;
+            rec.step = baud_step;  // the change didn't happen, redo it
+        }
+        if (resume && rec.pending_baud) {
+            rec.baud = current_baud;
+            rec.pending_baud = 0;
+        }
+    }
+    if (!resume) {
+        if (current_baud != BAUD_RATE)
+            module_responds(BAUD_RATE);
+        memset(&rec, 0, sizeof(rec));
+        rec.txn = txn;
+        rec.num_steps = save_step + 1;
+        rec.baud = current_baud;
+    }
+    int first_step = rec.step;
+
+    for (int step = rec.step; step < rec.num_steps; step++) {
+        int failed;
+        if (step < num_items) {
+            failed = cfg_apply_legacy(&cfg_profile[step], 1, CFG_LAYER_RAM, 0);
+            uart_tx_wait_blocking(UART_ID);  // PUBX,40 isn't acknowledged, it's done once it's out
+        } else if (step == baud_step) {
+            rec.pending_baud = JOURNAL_TARGET_BAUD;
+            journal_append(&rec);  // write ahead: on a power loss both bauds get tried
+            change_baud_rate(JOURNAL_TARGET_BAUD);
+            failed = !module_responds(JOURNAL_TARGET_BAUD);
+            if (!failed) {
+                rec.baud = JOURNAL_TARGET_BAUD;
+                rec.pending_baud = 0;
+            }
+        } else {
+            failed = cfg_apply_legacy(NULL, 0, CFG_LAYER_BBR, 0);  // just the CFG-CFG save
+        }
+        if (failed) {
+            printf("journaled configuration: step %d of %d failed\n", step + 1, rec.num_steps);
+            return step;
+        }
+        rec.step = step + 1;
+        if (rec.step == rec.num_steps && first_step == 0)
+            rec.cold_us = time_us_64() - start;
+        journal_append(&rec);
+    }
+    uint32_t us = time_us_64() - start;
+    if (first_step == rec.num_steps)
+        printf("journaled configuration: already applied, confirmed in %lu us, from scratch took %lu us\n",
+               (unsigned long)us, (unsigned long)rec.cold_us);
+    else if (first_step == 0)
+        printf("journaled configuration: applied %d steps from scratch in %lu us\n", rec.num_steps, (unsigned long)us);
+    else
+        printf("journaled configuration: resumed at step %d of %d in %lu us, from scratch took %lu us\n",
+               first_step + 1, rec.num_steps, (unsigned long)us, (unsigned long)rec.cold_us);
+    return -1;
+}
+
+
+void print_irq_stats(void) {
+    // cost of the RX interrupt in clk_sys cycles. the spread per byte is the
+    // jitter; with the hot paths in flash it's mostly XIP cache misses.
+    uint32_t ints = save_and_disable_interrupts();
+    uint32_t count = irq_count, bytes = irq_bytes, max = irq_cycles_max;
+    uint32_t byte_min = irq_byte_cycles_min, byte_max = irq_byte_cycles_max;
+    uint64_t cycles = irq_cycles;
+    restore_interrupts(ints);
+    if (!count)
+        return;
+    printf("rx irq (%s): %lu calls, %lu cycles/byte mean, %lu-%lu per call, worst call %lu cycles (%lu us)\n",
+#ifdef RAM_HOT_PATHS
+           "hot paths in RAM",
+#else
+           "hot paths in flash",
+#endif
+           (unsigned long)count, (unsigned long)(bytes ? cycles / bytes : 0), (unsigned long)byte_min,
+           (unsigned long)byte_max, (unsigned long)max,
+           (unsigned long)(max / (clock_get_hz(clk_sys) / 1000000)));
+}
+
+
+void benchmark_hot_paths(void) {
+    // feed a typical epoch (NAV-PVT, GGA, RMC, GSV) through the receive path a byte
+    // at a time, once with the XIP cache warm and once flushed before every frame,
+    // the worst case the interrupt sees when the main loop has evicted it. build
+    // with and without RAM_HOT_PATHS to compare. the RX interrupt must not be running.
+    static const char *sentences[] = {
+        "$GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B\r\n",
+        "$GPRMC,083559.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*57\r\n",
+        "$GPGSV,1,1,03,01,40,083,46,02,17,308,41,12,07,344,39*41\r\n",
+    };
+    uint8_t pvt[NAV_PVT_LEN] = { 0 };
+    uint8_t pvt_frame[NAV_PVT_LEN + 8];
+    size_t pvt_len = compile_ubx_msg(pvt_frame, UBX_CLASS_NAV, UBX_NAV_PVT, pvt, NAV_PVT_LEN);
+    int num_frames = 1 + sizeof(sentences) / sizeof(sentences[0]);
+
+    for (int cold = 0; cold < 2; cold++) {
+        uint32_t min = UINT32_MAX, max = 0, bytes = 0;
+        uint64_t total = 0;
+        for (int e = 0; e < HOT_BENCH_EPOCHS; e++) {
+            for (int f = 0; f < num_frames; f++) {
+                const uint8_t *frame = f == 0 ? pvt_frame : (const uint8_t *)sentences[f - 1];
+                size_t len = f == 0 ? pvt_len : strlen(sentences[f - 1]);
+                if (cold) {
+                    xip_ctrl_hw->flush = 1;
+                    (void)xip_ctrl_hw->flush;  // the read blocks until the flush is done
+                }
+                uint32_t start = systick_hw->cvr;
+                for (size_t i = 0; i < len; i++)
+                    feed_rx_byte(frame[i]);
+                uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+                total += cycles;
+                bytes += len;
+                if (cycles / len < min)
+                    min = cycles / len;
+                if (cycles / len > max)
+                    max = cycles / len;
+            }
+        }
+        printf("receive path, XIP cache %s: %lu cycles/byte mean, %lu-%lu per frame\n", cold ? "flushed" : "warm",
+               (unsigned long)(total / bytes), (unsigned long)min, (unsigned long)max);
+    }
+}
+
+
+uint32_t gov_baud_error_ppm(uint32_t clk_hz, uint32_t baud) {
+    // error of the baud the PL011 divider gets closest to, same rounding as
+    // uart_set_baudrate(): 16 bit integer part, 6 bit fraction
+    uint32_t div = 8 * clk_hz / baud;
+    uint32_t ibrd = div >> 7;
+    uint32_t fbrd = ((div & 0x7f) + 1) / 2;
+    if (ibrd == 0) {
+        ibrd = 1;
+        fbrd = 0;
+    } else if (ibrd >= 65535) {
+        ibrd = 65535;
+        fbrd = 0;
+    }
+    uint32_t actual = (4ULL * clk_hz) / (64 * ibrd + fbrd);
+    uint32_t diff = actual > baud ? actual - baud : baud - actual;
+    return (uint32_t)(diff * 1000000ULL / baud);
+}
+
+
+int governor_setup(void) {
+    // check the UART bauds in use are still accurate from GOV_PERI_HZ, move clk_peri
+    // there, then work out the PLL settings of each step within the bounds. returns
+    // the number of usable steps, 0 if the governor stays off.
+    const uint32_t bauds[] = { current_baud, MAVLINK_BAUD_RATE, BATCH_RETRIEVE_BAUD, JOURNAL_TARGET_BAUD };
+    for (size_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+        uint32_t ppm = gov_baud_error_ppm(GOV_PERI_HZ, bauds[i]);
+        if (ppm > GOV_MAX_BAUD_ERROR_PPM) {
+            printf("clock governor off: %lu baud is %lu ppm off from clk_peri at %lu Hz\n",
+                   (unsigned long)bauds[i], (unsigned long)ppm, (unsigned long)GOV_PERI_HZ);
+            return 0;
+        }
+    }
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, GOV_PERI_HZ, GOV_PERI_HZ);
+    uart_set_baudrate(UART_ID, current_baud);  // a byte or two in flight may be garbled, the parsers resync
+    uart_set_baudrate(MAVLINK_UART_ID, MAVLINK_BAUD_RATE);
+
+    int usable = 0;
+    uint32_t khz = clock_get_hz(clk_sys) / 1000;
+    for (int i = 0; i < GOV_STEPS; i++) {
+        uint vco, postdiv1, postdiv2;
+        gov_vco[i] = 0;
+        if (gov_khz[i] < GOV_MIN_KHZ || gov_khz[i] > GOV_MAX_KHZ ||
+            !check_sys_clock_khz(gov_khz[i], &vco, &postdiv1, &postdiv2))
+            continue;
+        gov_vco[i] = vco;
+        gov_postdiv1[i] = postdiv1;
+        gov_postdiv2[i] = postdiv2;
+        gov_step_us[i] = 0;
+        usable++;
+        if (gov_step < 0 || gov_khz[i] <= khz)
+            gov_step = i;  // start at the running clock, or the closest step below it
+    }
+    if (!usable) {
+        gov_step = -1;
+        printf("clock governor off: no step between %lu and %lu kHz\n",
+               (unsigned long)GOV_MIN_KHZ, (unsigned long)GOV_MAX_KHZ);
+        return 0;
+    }
+    int start = gov_step;
+    gov_step = -1;
+    governor_set_step(start);
+    gov_changes = 0;
+    printf("clock governor on: %d steps, clk_peri at %lu Hz, starting at %lu kHz\n",
+           usable, (unsigned long)GOV_PERI_HZ, (unsigned long)gov_khz[start]);
+    return usable;
+}
+
+
+void governor_set_step(int step) {
+    // the sequence of set_sys_clock_khz(), without it putting clk_peri back on
+    // clk_sys. interrupts stay on, the RX interrupt runs from the USB PLL meanwhile.
+    uint64_t now = time_us_64();
+    if (gov_step >= 0)
+        gov_step_us[gov_step] += now - gov_step_start_us;
+    if (step != gov_step && clock_get_hz(clk_sys) != gov_khz[step] * 1000) {
+        clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+        pll_init(pll_sys, 1, gov_vco[step], gov_postdiv1[step], gov_postdiv2[step]);
+        clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, gov_khz[step] * 1000, gov_khz[step] * 1000);
+        // SCL counts are in clk_sys cycles. only the blocks in use, setting the baud enables one
+        if (i2c_get_hw(REGMAP_I2C_ID)->enable)
+            i2c_set_baudrate(REGMAP_I2C_ID, REGMAP_I2C_BAUD);
+        if (i2c_get_hw(DDC_I2C_ID)->enable)
+            i2c_set_baudrate(DDC_I2C_ID, DDC_I2C_BAUD);
+        gov_changes++;
+    }
+    gov_step = step;
+    gov_step_start_us = time_us_64();
+    gov_window_start_us = gov_step_start_us;  // cycle counts from the old clock are meaningless now
+    gov_cycles = 0;
+    gov_passes = 0;
+    gov_idle_cycles = UINT32_MAX;
+    gov_pressure_peak = 0;
+    gov_quiet_windows = 0;
+}
+
+
+int governor_pressure(void) {
+    // % of the fullest buffer between the RX interrupt and the main loop
+    int pressure = (FRAME_POOL_SIZE - frame_free_count) * 100 / FRAME_POOL_SIZE;
+    for (int i = 0; i < NUM_SINKS; i++) {
+        if (!sinks[i].enabled)
+            continue;
+        int backlog = (uint8_t)(sinks[i].head - sinks[i].tail) * 100 / SINK_QUEUE_LEN;
+        if (backlog > pressure)
+            pressure = backlog;
+    }
+    int raw = (uint16_t)(raw_head - raw_tail) * 100 / RAW_RING_LEN;
+    return raw > pressure ? raw : pressure;
+}
+
+
+void governor_tick(uint32_t start_cycles, uint64_t start_us) {
+    // called at the end of every main loop pass. the cheapest pass in a window is
+    // taken as the cost of finding nothing to do, everything above it is load,
+    // the RX interrupt included since SysTick keeps counting through it.
+    if (gov_step < 0)
+        return;
+    uint64_t now = time_us_64();
+    uint64_t cycles = (start_cycles - systick_hw->cvr) & 0x00FFFFFF;
+    if (now - start_us > 50000)
+        cycles = (now - start_us) * gov_khz[gov_step] / 1000;  // SysTick wraps in 126 ms at 133 MHz
+    gov_cycles += cycles;
+    gov_passes++;
+    if (cycles < gov_idle_cycles)
+        gov_idle_cycles = cycles;
+    int pressure = governor_pressure();
+    if (pressure > gov_pressure_peak)
+        gov_pressure_peak = pressure;
+    if (now - gov_window_start_us < GOV_WINDOW_MS * 1000ULL)
+        return;
+
+    uint64_t window = (now - gov_window_start_us) * gov_khz[gov_step] / 1000;
+    uint64_t idle = (uint64_t)gov_passes * gov_idle_cycles;
+    int load = gov_cycles > idle ? (int)((gov_cycles - idle) * 100 / window) : 0;
+    gov_load = load > 100 ? 100 : load;
+    if (gov_load > gov_load_max)
+        gov_load_max = gov_load;
+    pressure = gov_pressure_peak;
+    gov_window_start_us = now;
+    gov_cycles = 0;
+    gov_passes = 0;
+    gov_idle_cycles = UINT32_MAX;
+    gov_pressure_peak = 0;
+
+    int up = -1, down = -1;
+    for (int i = gov_step + 1; i < GOV_STEPS && up < 0; i++)
+        if (gov_vco[i])
+            up = i;
+    for (int i = gov_step - 1; i >= 0 && down < 0; i--)
+        if (gov_vco[i])
+            down = i;
+    if (up >= 0 && pressure > GOV_UP_PRESSURE) {
+        for (int i = GOV_STEPS - 1; i > gov_step; i--) {
+            if (gov_vco[i]) {
+                governor_set_step(i);  // the backlog is growing now, no time for steps
+                return;
+            }
+        }
+    }
+    if (up >= 0 && gov_load > GOV_MAX_LOAD) {
+        // the lowest step that brings the load back under the bound, assuming it
+        // scales with the clock
+        int target = up;
+        for (int i = up; i < GOV_STEPS; i++) {
+            if (!gov_vco[i])
+                continue;
+            target = i;
+            if ((uint64_t)gov_load * gov_khz[gov_step] / gov_khz[i] <= GOV_MAX_LOAD)
+                break;
+        }
+        governor_set_step(target);
+        return;
+    }
+    if (down >= 0 && pressure <= GOV_DOWN_PRESSURE &&
+        (uint64_t)gov_load * gov_khz[gov_step] / gov_khz[down] < GOV_DOWN_LOAD) {
+        if (++gov_quiet_windows >= GOV_DOWN_WINDOWS)
+            governor_set_step(down);
+    } else {
+        gov_quiet_windows = 0;
+    }
+}
+
+
+void print_governor_stats(void) {
+    // time at each step, and the supply current that saved against staying at the
+    // SDK's default 125 MHz, from the linear GOV_BASE_UA + GOV_UA_PER_MHZ model
+    if (gov_step < 0)
+        return;
+    uint64_t now = time_us_64();
+    gov_step_us[gov_step] += now - gov_step_start_us;
+    gov_step_start_us = now;
+    uint64_t total_us = 0, ua_us = 0;
+    for (int i = 0; i < GOV_STEPS; i++) {
+        total_us += gov_step_us[i];
+        ua_us += gov_step_us[i] * (GOV_BASE_UA + GOV_UA_PER_MHZ * gov_khz[i] / 1000);
+    }
+    if (!total_us)
+        return;
+    printf("clock governor: %lu kHz, load %d%% (max %d%%), %lu changes:", (unsigned long)gov_khz[gov_step],
+           gov_load, gov_load_max, (unsigned long)gov_changes);
+    for (int i = 0; i < GOV_STEPS; i++)
+        if (gov_vco[i])
+            printf(" %lu MHz %lu%%", (unsigned long)(gov_khz[i] / 1000),
+                   (unsigned long)(gov_step_us[i] * 100 / total_us));
+    uint32_t avg_ua = ua_us / total_us;
+    uint32_t default_ua = GOV_BASE_UA + GOV_UA_PER_MHZ * 125;
+    float saved_mah = (default_ua > avg_ua ? default_ua - avg_ua : 0) * (total_us / 3600e9f) / 1000.0f;
+    printf("\n  ~%lu.%lu mA average vs ~%lu.%lu mA at 125 MHz, ~%.2f mAh saved\n",
+           (unsigned long)(avg_ua / 1000), (unsigned long)(avg_ua % 1000 / 100),
+           (unsigned long)(default_ua / 1000), (unsigned long)(default_ua % 1000 / 100), saved_mah);
+}
+
+
+int HOT_FUNC(flow_free_slots)(void) {
+    // room left between the RX interrupt and the main loop, in frames or raw records
+    int raw = RAW_RING_LEN - (uint16_t)(raw_head - raw_tail);
+    return raw < frame_free_count ? raw : frame_free_count;
+}
+
+
+int uart_flow_probe(void) {
+    // which handshake lines are wired to something that uses them. CTS is pulled
+    // up, so only a module driving it reads as clear to send. for RTS, a CFG-RATE
+    // poll sent while it's dropped must only be answered once it's raised again.
+    int lines = 0;
+    gpio_set_function(FLOW_CTS_PIN, GPIO_FUNC_UART);
+    gpio_pull_up(FLOW_CTS_PIN);
+    gpio_set_function(FLOW_RTS_PIN, GPIO_FUNC_UART);
+    uart_set_hw_flow(UART_ID, false, false);
+    hw_set_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTS_BITS);
+    busy_wait_ms(10);
+    if (uart_get_hw(UART_ID)->fr & UART_UARTFR_CTS_BITS)
+        lines |= FLOW_CTS;
+
+    hw_clear_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTS_BITS);
+    busy_wait_ms(20);  // let whatever was already on its way in arrive
+    uint32_t replies = cfg_acks;
+    send_ubx_frame(UBX_CLASS_CFG, UBX_CFG_RATE, NULL, 0);
+    int held = wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_RATE) < 0;
+    hw_set_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTS_BITS);
+    if (held && wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_RATE) >= 0)
+        lines |= FLOW_RTS;
+    return lines;
+}
+
+
+int uart_flow_setup(void) {
+    // FIFO on, then whichever handshake lines work. without any it falls back to
+    // the FIFO alone, which still gives the interrupt 32 bytes of slack instead of 1.
+    // returns the lines in use.
+    int lines = uart_flow_probe();
+    uart_set_fifo_enabled(UART_ID, true);
+    uart_set_hw_flow(UART_ID, lines & FLOW_CTS, lines & FLOW_RTS);
+    flow_held = 0;
+    flow_lines = lines;
+    printf("uart flow control: FIFO%s%s%s\n", lines & FLOW_CTS ? ", CTS" : "", lines & FLOW_RTS ? ", RTS" : "",
+           lines ? "" : " only, no handshake lines answered the probe");
+    return lines;
+}
+
+
+void uart_flow_off(void) {
+    // back to how uart_tx_setup() leaves it, with RTS held asserted in case the
+    // module does look at it
+    flow_lines = 0;
+    flow_held = 0;
+    uart_set_hw_flow(UART_ID, false, false);
+    hw_set_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTS_BITS);
+    uart_set_fifo_enabled(UART_ID, false);
+}
+
+
+void service_flow(void) {
+    // called from the main loop. hands RTS back to the PL011 once the sinks and
+    // the raw reader have freed enough room.
+    if (!flow_held || flow_free_slots() < FLOW_RESUME_FREE)
+        return;
+    uint32_t ints = save_and_disable_interrupts();
+    hw_set_bits(&uart_get_hw(UART_ID)->cr, UART_UARTCR_RTSEN_BITS);
+    flow_held = 0;
+    restore_interrupts(ints);
+}
+
+
+void compare_flow_modes(int testrun) {
+    // the same high rate output at BATCH_RETRIEVE_BAUD while the pico holds its
+    // interrupts off for FLOW_STALL_US every FLOW_STALL_PERIOD_MS, first unflowed
+    // as uart_tx_setup() leaves it, then flow controlled. leaves flow control on.
+    if (testrun) {
+        printf("would compare unflowed and flow controlled reception at %d baud\n", BATCH_RETRIEVE_BAUD);
+        return;
+    }
+    int baud = current_baud;
+    uint16_t period_ms = nav_period_ms;
+    change_baud_rate(BATCH_RETRIEVE_BAUD);
+    set_nav_rate(FLOW_BENCH_PERIOD_MS);
+    set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_SAT, 1);
+    for (int mode = 0; mode < 2; mode++) {
+        if (mode)
+            uart_flow_setup();
+        else
+            uart_flow_off();
+        sleep_ms(500);  // let the output settle after the switch
+        uint32_t bytes = rx_bytes, overruns = rx_overruns, holds = flow_holds;
+        uint32_t bad = ubx_bad_frames + nmea_bad_sentences, fixes = pvt_count;
+        uint64_t start = time_us_64();
+        uint64_t next_stall_us = start;
+        while (time_us_64() - start < FLOW_BENCH_S * 1000000ULL) {
+            if (time_us_64() >= next_stall_us) {
+                next_stall_us += FLOW_STALL_PERIOD_MS * 1000ULL;
+                uint32_t ints = save_and_disable_interrupts();
+                busy_wait_us(FLOW_STALL_US);
+                restore_interrupts(ints);
+            }
+            service_sinks();
+            service_flow();
+        }
+        printf("%s: %lu bytes/s, %lu overruns, %lu bad frames, %lu NAV-PVT, %lu RTS holds\n",
+               mode ? "flow controlled" : "unflowed", (unsigned long)((rx_bytes - bytes) / FLOW_BENCH_S),
+               (unsigned long)(rx_overruns - overruns), (unsigned long)(ubx_bad_frames + nmea_bad_sentences - bad),
+               (unsigned long)(pvt_count - fixes), (unsigned long)(flow_holds - holds));
+    }
+    set_ubx_rate(UBX_CLASS_NAV, UBX_NAV_SAT, 0);
+    set_nav_rate(period_ms);
+    change_baud_rate(baud);
+}
+
+
+void print_flow_stats(void) {
+    printf("uart: %lu overruns, RTS held %lu times for the frame pool%s\n", (unsigned long)rx_overruns,
+           (unsigned long)flow_holds, flow_held ? ", held now" : "");
+}
+
+
+int configure_ddc_port(uint16_t threshold, int testrun) {
+    // UBX-CFG-PRT for DDC: UBX and NMEA in, UBX out, the NMEA stays on the UART
+    // so it isn't handled twice. txReady active high on
+    // TXREADY_MODULE_PIO once more than `threshold` bytes are pending, 0 for no
+    // txReady. reads are sized to the threshold. returns 1 if acknowledged.
+    uint16_t units = (threshold + 7) / 8;  // thres is in units of 8 bytes, 9 bits
+    if (units > 0x1FF)
+        units = 0x1FF;
+    uint16_t tx_ready = threshold ? 0x01 | (TXREADY_MODULE_PIO << 2) | (units << 7) : 0;  // en, pol 0, pin, thres
+    uint8_t payload[20] = { 0 };
+    payload[0] = 0x00;  // portID: DDC
+    payload[2] = tx_ready & 0xFF;
+    payload[3] = tx_ready >> 8;
+    payload[4] = DDC_I2C_ADDRESS << 1;  // mode: slaveAddr in bits 7..1
+    payload[12] = 0x03;  // inProtoMask: UBX, NMEA
+    payload[14] = 0x01;  // outProtoMask: UBX
+    ddc_threshold = units * 8;
+    ddc_burst = ddc_threshold < DDC_BURST_MIN ? DDC_BURST_MIN : ddc_threshold > DDC_BURST_MAX ? DDC_BURST_MAX : ddc_threshold;
+    if (testrun) {
+        printf("would set DDC txReady to %s%d bytes\n", threshold ? "" : "off, ", ddc_threshold);
+        return 1;
+    }
+    uint32_t replies = cfg_acks;
+    cfg_write(UBX_CLASS_CFG, UBX_CFG_PRT, payload, sizeof(payload), testrun);
+    int acked = wait_for_cfg_ack(replies, UBX_CLASS_CFG, UBX_CFG_PRT) == 1;
+    if (!acked)
+        printf("CFG-PRT for DDC wasn't acknowledged\n");
+    txready_edges_seen = txready_edges;
+    ddc_next_poll_us = time_us_64();
+    return acked;
+}
+
+
+void ddc_setup(void) {
+    gpio_init(DDC_SDA_PIN);
+    gpio_set_function(DDC_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(DDC_SDA_PIN);
+    gpio_init(DDC_SCL_PIN);
+    gpio_set_function(DDC_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(DDC_SCL_PIN);
+    i2c_init(DDC_I2C_ID, DDC_I2C_BAUD);
+    ddc_ubx_rx.source = RAW_SOURCE_DDC;
+    gpio_init(TXREADY_PIN);
+    gpio_set_dir(TXREADY_PIN, GPIO_IN);
+    gpio_pull_down(TXREADY_PIN);
+    gpio_set_irq_enabled_with_callback(TXREADY_PIN, GPIO_IRQ_EDGE_RISE, true, gpio_event);
+}
+
+
+void txready_pin_changed(void) {
+    // GPIO interrupt: the main loop does the reading
+    txready_edges++;
+}
+
+
+int ddc_available(void) {
+    // bytes pending in the module's DDC buffer, -1 if it didn't answer
+    uint8_t reg = DDC_REG_AVAIL;
+    uint8_t count[2];
+    uint64_t start = time_us_64();
+    int ok = i2c_write_blocking(DDC_I2C_ID, DDC_I2C_ADDRESS, &reg, 1, true) == 1 &&
+             i2c_read_blocking(DDC_I2C_ID, DDC_I2C_ADDRESS, count, 2, false) == 2;
+    ddc_bus_us += time_us_64() - start;
+    ddc_transactions++;
+    return ok ? count[0] << 8 | count[1] : -1;
+}
+
+
+uint32_t service_ddc(void) {
+    // called from the main loop. with txReady, only after an edge or while the pin
+    // is still up, otherwise every DDC_POLL_MS. the pending bytes are read from
+    // 0xFF in bursts of ddc_burst and framed with the UART's interrupt masked, so
+    // the frame pool and sinks still see a single producer. returns the bytes read.
+    if (ddc_threshold) {
+        if (txready_edges == txready_edges_seen && !gpio_get(TXREADY_PIN))
+            return 0;
+        txready_edges_seen = txready_edges;
+    } else {
+        if (time_us_64() < ddc_next_poll_us)
+            return 0;
+        ddc_next_poll_us = time_us_64() + DDC_POLL_MS * 1000ULL;
+    }
+    int avail = ddc_available();
+    if (avail <= 0) {
+        ddc_empty++;
+        return 0;
+    }
+    uint8_t buf[DDC_BURST_MAX];
+    int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
+    uint32_t total = 0;
+    while (avail > 0) {
+        int n = avail < ddc_burst ? avail : ddc_burst;
+        uint64_t start = time_us_64();
+        n = i2c_read_blocking(DDC_I2C_ID, DDC_I2C_ADDRESS, buf, n, false);  // the address stays at 0xFF
+        ddc_bus_us += time_us_64() - start;
+        ddc_transactions++;
+        if (n <= 0)
+            break;
+        irq_set_enabled(UART_IRQ, false);
+        uint32_t pvts = pvt_count;
+        for (int i = 0; i < n; i++)
+            if (!ubx_parse_byte(&ddc_ubx_rx, buf[i]))
+                nmea_parse_byte(&ddc_nmea_rx, buf[i]);
+        if (pvt_count != pvts) {
+            ddc_pvt_count++;
+            ddc_pvt_offset_us = (int64_t)last_fix.rx_us - (int64_t)last_fix.itow * 1000;
+        }
+        irq_set_enabled(UART_IRQ, rx_enabled);
+        avail -= n;
+        total += n;
+    }
+    ddc_bytes += total;
+    return total;
+}
+
+
+void compare_txready_thresholds(int testrun) {
+    // read over DDC for DDC_BENCH_S at each threshold, polling first. bus time is
+    // what our transactions took at DDC_I2C_BAUD. latency is that of NAV-PVT read
+    // over DDC, from the offset between its arrival and its iTOW, above the best
+    // offset over the UART. NAV-PVT is only on one port at a time, the UART's is
+    // measured for DDC_UART_REF_S just before each threshold so the pico's clock
+    // drift between the two stays small.
+    static const uint16_t thresholds[] = { 0, 8, 64, 256, 1024 };
+    if (testrun) {
+        printf("would compare %d txReady thresholds over DDC\n", (int)(sizeof(thresholds) / sizeof(thresholds[0])));
+        return;
+    }
+    for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+        set_ubx_port_rates(UBX_CLASS_NAV, UBX_NAV_PVT, 0, 1);
+        sleep_ms(500);
+        int64_t uart_best = INT64_MAX;
+        uint32_t last_pvt = pvt_count;
+        uint64_t start = time_us_64();
+        while (time_us_64() - start < DDC_UART_REF_S * 1000000ULL) {
+            service_sinks();
+            if (pvt_count != last_pvt) {
+                last_pvt = pvt_count;
+                uint32_t ints = save_and_disable_interrupts();
+                int64_t offset = (int64_t)last_fix.rx_us - (int64_t)last_fix.itow * 1000;
+                restore_interrupts(ints);
+                if (offset < uart_best)
+                    uart_best = offset;
+            }
+        }
+        if (!configure_ddc_port(thresholds[t], testrun))
+            continue;
+        set_ubx_port_rates(UBX_CLASS_NAV, UBX_NAV_PVT, 1, 0);
+        sleep_ms(500);
+        while (service_ddc())
+            ;  // whatever was pending before the change
+        uint64_t bus_us = ddc_bus_us;
+        uint32_t transactions = ddc_transactions, empty = ddc_empty, bytes = ddc_bytes;
+        int64_t offsets[DDC_LATENCY_SAMPLES];
+        int samples = 0;
+        last_pvt = ddc_pvt_count;
+        start = time_us_64();
+        while (time_us_64() - start < DDC_BENCH_S * 1000000ULL) {
+            service_ddc();
+            service_sinks();
+            if (ddc_pvt_count != last_pvt) {
+                last_pvt = ddc_pvt_count;
+                if (samples < DDC_LATENCY_SAMPLES)
+                    offsets[samples++] = ddc_pvt_offset_us;
+            }
+        }
+        int64_t best = uart_best, sum = 0, worst = INT64_MIN;  // DDC can beat a slow UART, so it's signed
+        if (best == INT64_MAX)  // no NAV-PVT on the UART, fall back to the best over DDC
+            for (int i = 0; i < samples; i++)
+                if (offsets[i] < best)
+                    best = offsets[i];
+        for (int i = 0; i < samples; i++) {
+            sum += offsets[i] - best;
+            if (offsets[i] - best > worst)
+                worst = offsets[i] - best;
+        }
+        if (!samples)
+            worst = 0;
+        printf("txReady %4d: bus %.2f%%, %lu transactions/s (%lu empty), %lu bytes/s, NAV-PVT %+ld us mean %+ld max over the UART\n",
+               ddc_threshold, 100.0 * (ddc_bus_us - bus_us) / (DDC_BENCH_S * 1000000.0),
+               (unsigned long)((ddc_transactions - transactions) / DDC_BENCH_S), (unsigned long)(ddc_empty - empty),
+               (unsigned long)((ddc_bytes - bytes) / DDC_BENCH_S), (long)(samples ? sum / samples : 0), (long)worst);
+    }
+    configure_ddc_port(TXREADY_THRESHOLD, testrun);
+}
+
+
+void print_ddc_stats(void) {
+    printf("ddc: %lu bytes in %lu transactions (%lu empty), bus busy %lu ms, txReady at %d bytes\n",
+           (unsigned long)ddc_bytes, (unsigned long)ddc_transactions, (unsigned long)ddc_empty,
+           (unsigned long)(ddc_bus_us / 1000), ddc_threshold);
+}
+
+
+void __attribute__((noinline)) stack_paint(void) {
+    // core 0 from the bottom of its stack up to just below this frame. core 1's
+    // whole stack the first time, nothing launches it in this program, so its
+    // mark only moves if something is added that does.
+    static int core1_painted = 0;
+    uint32_t here;
+    uint32_t *limit = (uint32_t *)((uintptr_t)&here - STACK_PAINT_MARGIN);
+    for (uint32_t *p = __StackBottom; p < limit; p++)
+        *p = STACK_PAINT;
+    if (!core1_painted) {
+        for (uint32_t *p = __StackOneBottom; p < __StackOneTop; p++)
+            *p = STACK_PAINT;
+        core1_painted = 1;
+    }
+}
+
+
+uint32_t stack_high_water(const uint32_t *bottom, const uint32_t *top) {
+    // bytes of the stack that have been used since it was painted. the whole stack
+    // means it probably ran past the bottom, into whatever the linker put there.
+    const uint32_t *p = bottom;
+    while (p < top && *p == STACK_PAINT)
+        p++;
+    return (uint32_t)((top - p) * sizeof(uint32_t));
+}
+
+
+void print_stack_stats(const char *when) {
+    uint32_t size0 = (__StackTop - __StackBottom) * sizeof(uint32_t);
+    uint32_t size1 = (__StackOneTop - __StackOneBottom) * sizeof(uint32_t);
+    uint32_t used0 = stack_high_water(__StackBottom, __StackTop);
+    uint32_t used1 = stack_high_water(__StackOneBottom, __StackOneTop);
+    printf("stack high water%s%s: core 0 %lu of %lu bytes%s, core 1 %lu of %lu bytes\n", when ? " after " : "",
+           when ? when : "", (unsigned long)used0, (unsigned long)size0, used0 == size0 ? " (overflowed?)" : "",
+           (unsigned long)used1, (unsigned long)size1);
+}
+
+
+void tasks_reset(void) {
+    for (int i = 0; i < NUM_TASKS; i++) {
+        tasks[i].cycles = 0;
+        tasks[i].calls = 0;
+        tasks[i].idle = UINT32_MAX;
+        tasks[i].max = 0;
+    }
+    tasks_since_us = time_us_64();
+}
+
+
+uint32_t task_done(int task, uint32_t start) {
+    // charge the SysTick cycles since `start` to `task`. returns the reading to
+    // start the next task from, so back to back tasks cost one read each.
+    uint32_t now = systick_hw->cvr;
+    uint32_t cycles = (start - now) & 0x00FFFFFF;  // SysTick counts down, 24 bits
+    task_stats_t *t = &tasks[task];
+    t->cycles += cycles;
+    t->calls++;
+    if (cycles < t->idle)
+        t->idle = cycles;
+    if (cycles > t->max)
+        t->max = cycles;
+    return now;
+}
+
+
+void print_task_stats(void) {
+    // share of the time since the last report each main loop task spent above its
+    // idle cost, what's left is idle. the RX interrupt is counted in whichever task
+    // it preempted, print_irq_stats() has it on its own. with the clock governor
+    // on, cycles are converted at the current clk_sys.
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    uint64_t wall = (time_us_64() - tasks_since_us) * mhz;
+    uint64_t busy = 0;
+    if (!wall)
+        return;
+    printf("main loop:");
+    for (int i = 0; i < NUM_TASKS; i++) {
+        task_stats_t *t = &tasks[i];
+        if (!t->calls)
+            continue;
+        uint64_t idle = i == TASK_STATS ? 0 : (uint64_t)t->calls * t->idle;
+        uint64_t cycles = t->cycles > idle ? t->cycles - idle : 0;
+        busy += cycles;
+        printf(" %s %lu.%lu%% (worst %lu us),", t->name, (unsigned long)(cycles * 100 / wall),
+               (unsigned long)(cycles * 1000 / wall % 10), (unsigned long)(t->max / mhz));
+    }
+    uint64_t idle = wall > busy ? wall - busy : 0;
+    printf(" idle %lu.%lu%%\n", (unsigned long)(idle * 100 / wall), (unsigned long)(idle * 1000 / wall % 10));
+    tasks_reset();
+}
+
+
+void HOT_FUNC(nmea_put)(nmea_writer_t *w, char c) {
+    *w->p++ = c;
+    w->ck ^= c;
+}
+
+
+void nmea_put_str(nmea_writer_t *w, const char *s) {
+    while (*s)
+        nmea_put(w, *s++);
+}
+
+
+void nmea_put_uint(nmea_writer_t *w, uint32_t v, int min_digits) {
+    // two digits per division from digit_pairs, written backwards into tmp first
+    char tmp[10];
+    int n = 0;
+    while (v >= 100) {
+        uint32_t q = v / 100;
+        const char *d = &digit_pairs[(v - q * 100) * 2];
+        tmp[n++] = d[1];
+        tmp[n++] = d[0];
+        v = q;
+    }
+    if (v >= 10) {
+        tmp[n++] = digit_pairs[v * 2 + 1];
+        tmp[n++] = digit_pairs[v * 2];
+    } else {
+        tmp[n++] = '0' + v;
+    }
+    while (n < min_digits)
+        tmp[n++] = '0';
+    while (n)
+        nmea_put(w, tmp[--n]);
+}
+
+
+void nmea_put_fixed(nmea_writer_t *w, int32_t v, int decimals) {
+    // v / 10^decimals with all the decimals, eg. (-1234, 2) -> "-12.34"
+    static const uint32_t scale[] = { 1, 10, 100, 1000, 10000, 100000 };
+    uint32_t u = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    if (v < 0)
+        nmea_put(w, '-');
+    nmea_put_uint(w, u / scale[decimals], 1);
+    if (decimals) {
+        nmea_put(w, '.');
+        nmea_put_uint(w, u % scale[decimals], decimals);
+    }
+}
+
+
+void nmea_begin(nmea_writer_t *w, char *buf, const char *type) {
+    w->p = buf;
+    *w->p++ = '$';  // not part of the checksum
+    w->ck = 0;
+    nmea_put_str(w, NMEA_OUT_TALKER);
+    nmea_put_str(w, type);
+}
+
+
+size_t nmea_end(nmea_writer_t *w, char *buf) {
+    // the checksum has been kept up as the sentence was written, just append it
+    uint8_t ck = w->ck;
+    *w->p++ = '*';
+    *w->p++ = hex_digits[ck >> 4];
+    *w->p++ = hex_digits[ck & 0x0F];
+    *w->p++ = '\r';
+    *w->p++ = '\n';
+    return w->p - buf;
+}
+
+
+void nmea_put_time(nmea_writer_t *w, const nav_fix_t *fix) {
+    // hhmmss.ss. NAV-PVT's nano can be negative, so this goes through centiseconds
+    // of the day. the date isn't carried when that wraps, it's 10 ms at most.
+    int32_t n = fix->nano + 5000000;  // rounded to the centisecond
+    int32_t frac = n >= 0 ? n / 10000000 : -((-n + 9999999) / 10000000);
+    int32_t cs = ((fix->hour * 60 + fix->min) * 60 + fix->sec) * 100 + frac;
+    if (cs < 0)
+        cs += 8640000;
+    else if (cs >= 8640000)
+        cs -= 8640000;
+    uint32_t s = cs / 100;
+    nmea_put_uint(w, s / 3600, 2);
+    nmea_put_uint(w, s / 60 % 60, 2);
+    nmea_put_uint(w, s % 60, 2);
+    nmea_put(w, '.');
+    nmea_put_uint(w, cs % 100, 2);
+}
+
+
+void nmea_put_coord(nmea_writer_t *w, int32_t v, int deg_digits, char pos, char neg) {
+    // 1e-7 deg to d..dmm.mmmmm,H
+    uint32_t u = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    uint32_t deg = u / 10000000;
+    uint32_t min = ((u - deg * 10000000) * 60 + 50) / 100;  // 1e-5 minutes, rounded
+    if (min >= 6000000) {
+        min -= 6000000;
+        deg++;
+    }
+    nmea_put_uint(w, deg, deg_digits);
+    nmea_put_uint(w, min / 100000, 2);
+    nmea_put(w, '.');
+    nmea_put_uint(w, min % 100000, 5);
+    nmea_put(w, ',');
+    nmea_put(w, v < 0 ? neg : pos);
+}
+
+
+uint8_t nmea_quality(const nav_fix_t *fix) {
+    // NAV-PVT fixType and flags to the GGA quality indicator
+    if (!(fix->flags & 0x01) || fix->fix_type == 0 || fix->fix_type > 4)
+        return 0;
+    if (fix->fix_type == 1)
+        return 6;  // dead reckoning only
+    if ((fix->flags >> 6) == 2)
+        return 4;  // RTK fixed
+    if ((fix->flags >> 6) == 1)
+        return 5;  // RTK float
+    return fix->flags & 0x02 ? 2 : 1;  // DGPS when differential corrections were applied
+}
+
+
+size_t nmea_format_gga(char *buf, const nav_fix_t *fix) {
+    // NAV-PVT has no HDOP, pDOP goes in its place. the geoid separation is the
+    // difference of the two heights.
+    nmea_writer_t w;
+    uint8_t quality = nmea_quality(fix);
+    nmea_begin(&w, buf, "GGA,");
+    nmea_put_time(&w, fix);
+    nmea_put(&w, ',');
+    if (quality) {
+        nmea_put_coord(&w, fix->lat, 2, 'N', 'S');
+        nmea_put(&w, ',');
+        nmea_put_coord(&w, fix->lon, 3, 'E', 'W');
+    } else {
+        nmea_put_str(&w, ",,,");
+    }
+    nmea_put(&w, ',');
+    nmea_put_uint(&w, quality, 1);
+    nmea_put(&w, ',');
+    nmea_put_uint(&w, fix->num_sv, 2);
+    nmea_put(&w, ',');
+    nmea_put_fixed(&w, fix->p_dop, 2);
+    nmea_put(&w, ',');
+    if (quality) {
+        nmea_put_fixed(&w, (fix->h_msl + (fix->h_msl < 0 ? -50 : 50)) / 100, 1);  // mm to 0.1 m, rounded
+        nmea_put_str(&w, ",M,");
+        int32_t sep = fix->height - fix->h_msl;
+        nmea_put_fixed(&w, (sep + (sep < 0 ? -50 : 50)) / 100, 1);
+        nmea_put_str(&w, ",M,,");
+    } else {
+        nmea_put_str(&w, ",M,,M,,");
+    }
+    return nmea_end(&w, buf);
+}
+
+
+size_t nmea_format_rmc(char *buf, const nav_fix_t *fix) {
+    // NMEA 2.3 RMC, with the mode indicator
+    static const char modes[] = { 'N', 'A', 'D', 'N', 'R', 'F', 'E' };  // by GGA quality
+    nmea_writer_t w;
+    uint8_t quality = nmea_quality(fix);
+    nmea_begin(&w, buf, "RMC,");
+    nmea_put_time(&w, fix);
+    nmea_put_str(&w, quality ? ",A," : ",V,");
+    if (quality) {
+        nmea_put_coord(&w, fix->lat, 2, 'N', 'S');
+        nmea_put(&w, ',');
+        nmea_put_coord(&w, fix->lon, 3, 'E', 'W');
+        nmea_put(&w, ',');
+        nmea_put_fixed(&w, ((uint64_t)fix->g_speed * 3600 + 926) / 1852, 3);  // mm/s to 0.001 knots
+        nmea_put(&w, ',');
+        nmea_put_fixed(&w, (fix->head_mot + 500) / 1000, 2);  // 1e-5 to 0.01 deg
+    } else {
+        nmea_put_str(&w, ",,,,,");
+    }
+    nmea_put(&w, ',');
+    if (fix->valid & 0x01) {
+        nmea_put_uint(&w, fix->day, 2);
+        nmea_put_uint(&w, fix->month, 2);
+        nmea_put_uint(&w, fix->year % 100, 2);
+    }
+    nmea_put_str(&w, ",,,");
+    nmea_put(&w, modes[quality]);
+    return nmea_end(&w, buf);
+}
+
+
+size_t nmea_format_zda(char *buf, const nav_fix_t *fix) {
+    nmea_writer_t w;
+    nmea_begin(&w, buf, "ZDA,");
+    nmea_put_time(&w, fix);
+    nmea_put(&w, ',');
+    if (fix->valid & 0x01) {
+        nmea_put_uint(&w, fix->day, 2);
+        nmea_put(&w, ',');
+        nmea_put_uint(&w, fix->month, 2);
+        nmea_put(&w, ',');
+        nmea_put_uint(&w, fix->year, 4);
+    } else {
+        nmea_put_str(&w, ",,");
+    }
+    nmea_put_str(&w, ",00,00");  // local zone, always UTC
+    return nmea_end(&w, buf);
+}
+
+
+int nmea_output_fix(const nav_fix_t *fix) {
+    // GGA, RMC and ZDA of one epoch. on uart0 an epoch is dropped rather than
+    // holding up the main loop if the previous one is still going out. returns 0
+    // if it was dropped.
+    if (nmea_out_dest == 1 && (mavlink_dma_chan < 0 || dma_channel_is_busy(mavlink_dma_chan))) {
+        nmea_out_dropped++;
+        return 0;
+    }
+    uint32_t start = time_us_32();
+    char *buf = nmea_out_buf[nmea_out_idx];
+    size_t len = nmea_format_gga(buf, fix);
+    len += nmea_format_rmc(buf + len, fix);
+    len += nmea_format_zda(buf + len, fix);
+    nmea_out_format_us += time_us_32() - start;
+    nmea_out_epochs++;
+    if (nmea_out_dest == 1) {
+        dma_channel_transfer_from_buffer_now(mavlink_dma_chan, buf, len);
+        nmea_out_idx ^= 1;
+    } else if (stdio_usb_connected()) {
+        fwrite(buf, 1, len, stdout);
+    }
+    return 1;
+}
+
+
+void print_nmea_output_stats(void) {
+    if (nmea_out_epochs == 0)
+        return;
+    printf("nmea output: %lu epochs on %s, %lu dropped, formatting %lu us per epoch\n",
+           (unsigned long)nmea_out_epochs, nmea_out_dest == 1 ? "uart0" : "USB", (unsigned long)nmea_out_dropped,
+           (unsigned long)(nmea_out_format_us / nmea_out_epochs));
+}
+
+
+void benchmark_nmea_output(void) {
+    // the three sentences from a typical fix, then the same GGA with sprintf()
+    // and get_checksum() the way send_nmea() does it, for comparison
+    nav_fix_t fix = { .year = 2024, .month = 3, .day = 14, .hour = 9, .min = 27, .sec = 25, .valid = 0x07,
+                      .nano = -1200000, .fix_type = 3, .flags = 0x01, .num_sv = 12, .lon = 85652650,
+                      .lat = 472852331, .height = 547600, .h_msl = 499600, .p_dop = 132, .g_speed = 1234,
+                      .head_mot = 7752000 };
+    char buf[NMEA_OUT_MAX];
+    size_t len = 0;
+    uint64_t start = time_us_64();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        len = nmea_format_gga(buf, &fix);
+        len += nmea_format_rmc(buf + len, &fix);
+        len += nmea_format_zda(buf + len, &fix);
+    }
+    uint64_t us = time_us_64() - start;
+    buf[len] = '\0';
+    printf("%s", buf);
+    printf("nmea output: %lu sentences/s, %lu bytes/s\n", (unsigned long)(3ULL * BENCH_ITERATIONS * 1000000 / us),
+           (unsigned long)((uint64_t)len * BENCH_ITERATIONS * 1000000 / us));
+
+    start = time_us_64();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        char raw[NMEA_MAX_LEN];
+        uint32_t lat_min = (fix.lat % 10000000 * 60 + 50) / 100;
+        uint32_t lon_min = (fix.lon % 10000000 * 60 + 50) / 100;
+        sprintf(raw, "$%sGGA,%02d%02d%02d.00,%02ld%02lu.%05lu,N,%03ld%02lu.%05lu,E,%d,%02d,%d.%02d,%ld.%ld,M,%ld.%ld,M,,*",
+                NMEA_OUT_TALKER, fix.hour, fix.min, fix.sec, (long)(fix.lat / 10000000), (unsigned long)(lat_min / 100000),
+                (unsigned long)(lat_min % 100000), (long)(fix.lon / 10000000), (unsigned long)(lon_min / 100000),
+                (unsigned long)(lon_min % 100000), nmea_quality(&fix), fix.num_sv, fix.p_dop / 100, fix.p_dop % 100,
+                (long)((fix.h_msl + 50) / 1000), (long)((fix.h_msl + 50) / 100 % 10),
+                (long)((fix.height - fix.h_msl + 50) / 1000), (long)((fix.height - fix.h_msl + 50) / 100 % 10));
+        sprintf(buf, "%s%02X\r\n", raw, get_checksum(raw));
+    }
+    us = time_us_64() - start;
+    printf("sprintf GGA: %lu sentences/s\n", (unsigned long)(1ULL * BENCH_ITERATIONS * 1000000 / us));
+}
+
+
+void lla_to_ecef(double lat, double lon, double h, double *ecef) {
+    // WGS84, lat and lon in radians, h and the result in m
+    double s = sin(lat), c = cos(lat);
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * s * s);
+    ecef[0] = (n + h) * c * cos(lon);
+    ecef[1] = (n + h) * c * sin(lon);
+    ecef[2] = (n * (1.0 - WGS84_E2) + h) * s;
+}
+
+
+void ned_set_home(ned_home_t *home, int32_t lat, int32_t lon, int32_t height) {
+    // everything the conversions need about the home point. this is the only
+    // place with floating point, it runs once per home.
+    const double unit = M_PI / 180.0 * 1e-7;  // 1e-7 deg in radians
+    double phi = lat * unit, lambda = lon * unit, h = height * 1e-3;
+    double s = sin(phi), c = cos(phi), sl = sin(lambda), cl = cos(lambda);
+    double w = 1.0 - WGS84_E2 * s * s;
+    double rn = WGS84_A / sqrt(w);  // prime vertical radius
+    double rm = WGS84_A * (1.0 - WGS84_E2) / (w * sqrt(w));  // meridian radius
+    double drm = 3.0 * WGS84_A * (1.0 - WGS84_E2) * WGS84_E2 * s * c / (w * w * sqrt(w));  // d rm / d phi
+    double ecef[3];
+    lla_to_ecef(phi, lambda, h, ecef);
+    home->lat = lat;
+    home->lon = lon;
+    home->height = height;
+    for (int i = 0; i < 3; i++)
+        home->ecef[i] = (int32_t)lround(ecef[i] * 100.0);
+    home->k_n = lround((rm + h) * unit * 1000.0 * 65536.0);
+    home->k_e = lround((rn + h) * c * unit * 1000.0 * 65536.0);
+    home->k_e_lat = lround(-(rn + h) * s * unit * unit * 1000.0 * 1099511627776.0);
+    home->k_n_lat2 = lround(0.5 * drm * unit * unit * 1000.0 * 1099511627776.0);
+    home->k_n_lon2 = lround(0.5 * (rn + h) * s * c * unit * unit * 1000.0 * 1099511627776.0);
+    home->k_n_h = lround(unit * 17592186044416.0);
+    home->k_e_h = lround(c * unit * 17592186044416.0);
+    home->k_d_n = lround(1.0 / (2.0 * (rm + h) * 1000.0) * 281474976710656.0);
+    home->k_d_e = lround(1.0 / (2.0 * (rn + h) * 1000.0) * 281474976710656.0);
+    const double rot[3][3] = {
+        { -s * cl, -s * sl, c },
+        { -sl, cl, 0.0 },
+        { -c * cl, -c * sl, -s },
+    };
+    for (int r = 0; r < 3; r++)
+        for (int i = 0; i < 3; i++)
+            home->rot[r][i] = lround(rot[r][i] * 1073741824.0);
+}
+
+
+void ned_from_lla(const ned_home_t *home, int32_t lat, int32_t lon, int32_t height, ned_t *ned) {
+    // tangent plane expansion around home, good to a few mm within 1 km and a
+    // few cm within 10 km (more towards the poles), see validate_ned(). past
+    // that the dropped third order terms reach metres, use NAV-POSECEF there.
+    // integer multiplies and shifts only.
+    int32_t dlat = lat - home->lat;
+    int64_t dlon64 = (int64_t)lon - home->lon;
+    if (dlon64 > 1800000000)
+        dlon64 -= 3600000000LL;  // across the antimeridian
+    else if (dlon64 < -1800000000)
+        dlon64 += 3600000000LL;
+    int32_t dlon = (int32_t)dlon64;
+    int32_t dh = height - home->height;
+    int64_t n = ((int64_t)dlat * home->k_n >> 16) + ((int64_t)dlat * dh * home->k_n_h >> 44) +
+                (((int64_t)dlat * dlat * home->k_n_lat2 + (int64_t)dlon * dlon * home->k_n_lon2) >> 40);
+    int64_t e = ((int64_t)dlon * home->k_e >> 16) + ((int64_t)dlon * dh * home->k_e_h >> 44) +
+                ((int64_t)dlon * dlat * home->k_e_lat >> 40);
+    int64_t drop = (((n * n) >> 16) * home->k_d_n + ((e * e) >> 16) * home->k_d_e) >> 32;
+    ned->n = (int32_t)n;
+    ned->e = (int32_t)e;
+    ned->d = (int32_t)(drop - dh);
+}
+
+
+void ned_from_ecef(const ned_home_t *home, const int32_t *ecef_cm, ned_t *ned) {
+    // the exact rotation, from NAV-POSECEF. within 200 km of home, the mm
+    // differences have to fit 32 bits.
+    int32_t d[3];
+    for (int i = 0; i < 3; i++)
+        d[i] = (ecef_cm[i] - home->ecef[i]) * 10;
+    int32_t out[3];
+    for (int r = 0; r < 3; r++) {
+        int64_t v = (int64_t)home->rot[r][0] * d[0] + (int64_t)home->rot[r][1] * d[1] +
+                    (int64_t)home->rot[r][2] * d[2];
+        out[r] = (int32_t)((v + (1 << 29)) >> 30);
+    }
+    ned->n = out[0];
+    ned->e = out[1];
+    ned->d = out[2];
+}
+
+
+void ned_reference(const ned_home_t *home, const double *ecef, double *ned) {
+    // double precision NED of an ECEF point (m) around home, in mm
+    const double unit = M_PI / 180.0 * 1e-7;
+    double phi = home->lat * unit, lambda = home->lon * unit;
+    double s = sin(phi), c = cos(phi), sl = sin(lambda), cl = cos(lambda);
+    double h[3], d[3];
+    lla_to_ecef(phi, lambda, home->height * 1e-3, h);
+    for (int i = 0; i < 3; i++)
+        d[i] = (ecef[i] - h[i]) * 1000.0;
+    ned[0] = -s * cl * d[0] - s * sl * d[1] + c * d[2];
+    ned[1] = -sl * d[0] + cl * d[1];
+    ned[2] = -c * cl * d[0] - c * sl * d[1] - s * d[2];
+}
+
+
+void validate_ned(void) {
+    // points at several ranges in every direction, with heights up to +-500 m,
+    // converted both ways and against the double reference. ECEF input is rounded
+    // to cm like NAV-POSECEF, which accounts for up to ~9 mm by itself. also the
+    // cycles per conversion, the reference being what soft float costs on the M0+.
+    static const int32_t ranges_m[] = { 100, 1000, 10000, 50000 };
+    static const int32_t homes[][3] = { { 472852331, 85652650, 547600 }, { -338688000, 1512093000, 30000 },
+                                        { 780000000, 155000000, 100000 } };  // Zurich, Sydney, Svalbard
+    const double unit = M_PI / 180.0 * 1e-7;
+    for (size_t hm = 0; hm < sizeof(homes) / sizeof(homes[0]); hm++) {
+        ned_home_t home;
+        ned_set_home(&home, homes[hm][0], homes[hm][1], homes[hm][2]);
+        printf("ned around %ld, %ld:\n", (long)homes[hm][0], (long)homes[hm][1]);
+        for (size_t r = 0; r < sizeof(ranges_m) / sizeof(ranges_m[0]); r++) {
+            double max_lla_h = 0, max_lla_v = 0, max_ecef = 0;
+            uint64_t cycles_lla = 0, cycles_ecef = 0, cycles_ref = 0;
+            for (int p = 0; p < NED_BENCH_POINTS; p++) {
+                double bearing = 2.0 * M_PI * p / NED_BENCH_POINTS;
+                double dist = ranges_m[r] * (0.5 + 0.5 * (p % 4) / 3.0);
+                int32_t lat = home.lat + (int32_t)(dist * cos(bearing) / 111132.0 * 1e7);
+                int32_t lon = home.lon + (int32_t)(dist * sin(bearing) / (111320.0 * cos(home.lat * unit)) * 1e7);
+                int32_t height = home.height + (p % 5 - 2) * 250000;
+                double ecef[3], ref[3];
+                int32_t ecef_cm[3];
+                ned_t lla_ned, ecef_ned;
+
+                uint32_t start = systick_hw->cvr;
+                lla_to_ecef(lat * unit, lon * unit, height * 1e-3, ecef);
+                ned_reference(&home, ecef, ref);
+                cycles_ref += (start - systick_hw->cvr) & 0x00FFFFFF;
+                for (int i = 0; i < 3; i++)
+                    ecef_cm[i] = (int32_t)lround(ecef[i] * 100.0);
+
+                start = systick_hw->cvr;
+                ned_from_lla(&home, lat, lon, height, &lla_ned);
+                cycles_lla += (start - systick_hw->cvr) & 0x00FFFFFF;
+                start = systick_hw->cvr;
+                ned_from_ecef(&home, ecef_cm, &ecef_ned);
+                cycles_ecef += (start - systick_hw->cvr) & 0x00FFFFFF;
+
+                double eh = hypot(lla_ned.n - ref[0], lla_ned.e - ref[1]), ev = fabs(lla_ned.d - ref[2]);
+                double ee = sqrt((ecef_ned.n - ref[0]) * (ecef_ned.n - ref[0]) + (ecef_ned.e - ref[1]) * (ecef_ned.e - ref[1]) +
+                                 (ecef_ned.d - ref[2]) * (ecef_ned.d - ref[2]));
+                if (eh > max_lla_h)
+                    max_lla_h = eh;
+                if (ev > max_lla_v)
+                    max_lla_v = ev;
+                if (ee > max_ecef)
+                    max_ecef = ee;
+            }
+            printf("  %6ld m: lla max error %.1f mm horizontal %.1f mm vertical, ecef %.1f mm; "
+                   "cycles %lu lla, %lu ecef, %lu double reference\n",
+                   (long)ranges_m[r], max_lla_h, max_lla_v, max_ecef, (unsigned long)(cycles_lla / NED_BENCH_POINTS),
+                   (unsigned long)(cycles_ecef / NED_BENCH_POINTS), (unsigned long)(cycles_ref / NED_BENCH_POINTS));
+        }
+    }
+}
+
+
+void print_ned_stats(void) {
+    if (!ned_home_set || ned_count == 0)
+        return;
+    printf("ned: home %ld, %ld; latest %ld %ld %ld mm; %lu conversions, %lu cycles each\n", (long)ned_home.lat,
+           (long)ned_home.lon, (long)last_ned.n, (long)last_ned.e, (long)last_ned.d, (unsigned long)ned_count,
+           (unsigned long)(ned_cycles / ned_count));
+}
+
+
+int32_t isin_q30(uint32_t angle) {
+    // sine of a whole turn as 2^32, Q30. folded onto +-a quarter turn, then
+    // z/2 (pi - z^2 (2 pi - 5 - z^2 (pi - 3))), exact at 0 and 1, ~4e-4 off in between.
+    int32_t v = (int32_t)angle;
+    int64_t z = v;  // quarter turns, Q30
+    if (v > (1 << 30))
+        z = (1LL << 31) - v;
+    else if (v < -(1 << 30))
+        z = -(1LL << 31) - v;
+    int64_t z2 = z * z >> 30;
+    int64_t t = 1377753070LL - (z2 * 152033939LL >> 30);  // 2 pi - 5, pi - 3
+    t = 3373259426LL - (z2 * t >> 30);                    // pi
+    return (int32_t)(z * t >> 31);
+}
+
+
+void dr_update(const nav_fix_t *fix, uint32_t epoch_ms, uint32_t wrap_ms, uint32_t frame_bytes) {
+    // the writer, main loop only. fills the buffer readers aren't on and flips to
+    // it. vel_n/e/d have to be set. fixes without gnssFixOK are skipped, queries keep
+    // extrapolating the last good one up to the horizon. before taking the new fix,
+    // what each model would have predicted for it goes into dr_errors.
+    if (!(fix->flags & 0x01))
+        return;
+    const dr_anchor_t *prev = dr_active >= 0 ? &dr_anchors[dr_active] : NULL;
+    uint32_t gap_ms = prev ? (epoch_ms + wrap_ms - prev->epoch_ms) % wrap_ms : 0;
+
+    // epoch to pico time. rx_us is when the frame had arrived, so the smallest
+    // rx_us - epoch is the least latency, less the frame's time on the wire and
+    // however long the module takes to start sending. it
+    // creeps up by ~60 ppm so that it follows the crystals drifting apart.
+    int64_t sample = (int64_t)fix->rx_us - (int64_t)frame_bytes * 10000000 / current_baud - DR_OUTPUT_LATENCY_US -
+                     (int64_t)epoch_ms * 1000;
+    if (!dr_synced || sample < dr_offset_us || sample - dr_offset_us > DR_RESYNC_US)
+        dr_offset_us = sample;
+    else
+        dr_offset_us += gap_ms / 16;
+    dr_synced = 1;
+
+    int32_t vel[3] = { fix->vel_n, fix->vel_e, fix->vel_d };
+    if (prev && gap_ms > 0 && gap_ms <= DR_MAX_GAP_MS) {
+        int32_t height = fix->height;
+        for (int order = 0; order < 3; order++) {
+            dr_position_t pos;
+            dr_extrapolate(prev, (int64_t)gap_ms * 1000, order, &pos);
+            int64_t dlon = (int64_t)fix->lon - pos.lon;
+            if (dlon > 1800000000)
+                dlon -= 3600000000LL;
+            else if (dlon < -1800000000)
+                dlon += 3600000000LL;
+            float n = (float)(((int64_t)(fix->lat - pos.lat) << 28) / prev->k_lat);
+            float e = (float)((dlon << 28) / prev->k_lon);
+            uint32_t h = (uint32_t)sqrtf(n * n + e * e);
+            uint32_t v = (uint32_t)abs(height - pos.height);
+            dr_error_t *err = &dr_errors[order];
+            err->count++;
+            err->sum_h += h;
+            err->sum_v += v;
+            if (h > err->max_h)
+                err->max_h = h;
+            if (v > err->max_v)
+                err->max_v = v;
+        }
+        dr_gap_ms += gap_ms;
+    }
+
+    int target = dr_active ^ 1;
+    if (dr_active < 0)
+        target = 0;
+    dr_anchor_t *a = &dr_anchors[target];
+    a->seq++;  // odd: a reader still on this buffer from before the last flip retries
+    __dmb();
+    a->epoch_ms = epoch_ms;
+    a->epoch_us = (uint64_t)((int64_t)epoch_ms * 1000 + dr_offset_us);
+    a->lat = fix->lat;
+    a->lon = fix->lon;
+    a->height = fix->height;
+    for (int i = 0; i < 3; i++) {
+        a->vel[i] = vel[i];
+        if (prev && gap_ms == 0) {
+            a->acc[i] = prev->acc[i];  // another sentence of the same epoch
+        } else if (prev && gap_ms <= DR_MAX_GAP_MS) {
+            int32_t acc = (int32_t)((int64_t)(vel[i] - prev->vel[i]) * 1000 / (int32_t)gap_ms);
+            a->acc[i] = acc > DR_MAX_ACCEL ? DR_MAX_ACCEL : acc < -DR_MAX_ACCEL ? -DR_MAX_ACCEL : acc;
+        } else {
+            a->acc[i] = 0;
+        }
+    }
+    // scale factors at this latitude and height, first order in e^2
+    uint32_t turn = (uint32_t)(((int64_t)fix->lat * 5124095576LL) >> 32);  // 1e-7 deg to 2^32 per turn
+    int64_t s = isin_q30(turn), c = isin_q30(turn + (1u << 30));
+    int64_t s2 = s * s >> 30;
+    if (c < DR_MIN_COS)
+        c = DR_MIN_COS;
+    int64_t k_lat = DR_K_LAT0 - (DR_K_LAT1 * s2 >> 30);
+    int64_t k_lon = ((DR_K_LON0 - (DR_K_LON1 * s2 >> 30)) << 30) / c;
+    a->k_lat = (int32_t)(k_lat - k_lat * fix->height / 6378137000LL);
+    a->k_lon = (int32_t)(k_lon - k_lon * fix->height / 6378137000LL);
+    __dmb();
+    a->seq++;
+    __dmb();  // the contents have to land before the index does
+    dr_active = target;
+    dr_updates++;
+}
+
+
+void HOT_FUNC(dr_extrapolate)(const dr_anchor_t *a, int64_t dt_us, int order, dr_position_t *out) {
+    // order 0 holds the position, 1 adds velocity, 2 acceleration too
+    out->age_us = dt_us > INT32_MAX ? INT32_MAX : dt_us < INT32_MIN ? INT32_MIN : (int32_t)dt_us;
+    if (dt_us > DR_HORIZON_MS * 1000)
+        dt_us = DR_HORIZON_MS * 1000;
+    else if (dt_us < -DR_HORIZON_MS * 1000)
+        dt_us = -DR_HORIZON_MS * 1000;
+    int64_t dt = dt_us * 274878 >> 22;  // s, Q16
+    int64_t d[3];
+    for (int i = 0; i < 3; i++) {
+        d[i] = order > 0 ? (int64_t)a->vel[i] * dt : 0;
+        if (order > 1)
+            d[i] += ((int64_t)a->acc[i] * dt >> 16) * dt >> 1;
+        d[i] >>= 16;  // mm
+    }
+    int64_t lon = a->lon + (d[1] * a->k_lon >> 28);
+    if (lon > 1800000000)
+        lon -= 3600000000LL;
+    else if (lon < -1800000000)
+        lon += 3600000000LL;
+    out->lat = a->lat + (int32_t)(d[0] * a->k_lat >> 28);
+    out->lon = (int32_t)lon;
+    out->height = a->height - (int32_t)d[2];
+}
+
+
+int HOT_FUNC(dr_predict)(uint64_t t_us, dr_position_t *out) {
+    // position at pico time `t_us`, from any core or interrupt. never waits on the
+    // writer, it only ever fills the buffer that isn't active; the retry is for a
+    // reader that sat on a buffer through a whole epoch. returns 0, 1 if clamped to
+    // the horizon, -1 before the first fix.
+    dr_anchor_t a;
+    uint32_t seq;
+    int i;
+    do {
+        i = dr_active;
+        if (i < 0)
+            return -1;
+        seq = ((volatile dr_anchor_t *)&dr_anchors[i])->seq;
+        __dmb();
+        a = dr_anchors[i];
+        __dmb();
+    } while ((seq & 1) || seq != ((volatile dr_anchor_t *)&dr_anchors[i])->seq);
+    int64_t dt_us = (int64_t)(t_us - a.epoch_us);
+    dr_extrapolate(&a, dt_us, 2, out);
+    return dt_us > DR_HORIZON_MS * 1000 ? 1 : 0;
+}
+
+
+void dr_update_pvt(const nav_fix_t *fix) {
+    dr_update(fix, fix->itow, 604800000, 100);  // 92 byte payload
+}
+
+
+void dr_update_nmea(nav_fix_t *fix) {
+    // RMC has speed and course over ground only, nothing vertical. GGA and RMC of
+    // one epoch both come through here, the second refreshes the first.
+    uint32_t epoch_ms = ((fix->hour * 60 + fix->min) * 60 + fix->sec) * 1000 + fix->nano / 1000000;
+    uint32_t turn = (uint32_t)(((int64_t)fix->head_mot * 500399959) >> 22);  // 1e-5 deg to 2^32 per turn
+    fix->vel_n = (int32_t)((int64_t)fix->g_speed * isin_q30(turn + (1u << 30)) >> 30);
+    fix->vel_e = (int32_t)((int64_t)fix->g_speed * isin_q30(turn) >> 30);
+    fix->vel_d = 0;
+    dr_update(fix, epoch_ms, 86400000, 72);
+}
+
+
+void measure_dr_replay(void) {
+    // replay a log with NAV-PVT over USB and see how far each model's prediction
+    // lands from the next fix. a log recorded at a faster rate than the one flown
+    // shows the gaps the controller would actually see.
+    dr_active = -1;
+    dr_synced = 0;
+    dr_updates = 0;
+    dr_gap_ms = 0;
+    memset(dr_errors, 0, sizeof(dr_errors));
+    replay_from_stdin(dr_update_pvt);
+    if (dr_errors[0].count == 0) {
+        printf("no consecutive NAV-PVT fixes in the replayed log\n");
+        return;
+    }
+    print_dr_stats();
+}
+
+
+void print_dr_stats(void) {
+    if (dr_active < 0)
+        return;
+    static const char *models[] = { "hold", "velocity", "velocity + acceleration" };
+    dr_position_t pos;
+    uint32_t start = systick_hw->cvr;
+    dr_predict(time_us_64(), &pos);
+    uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+    printf("dead reckoning: %lu fixes, query %lu cycles, now %ld, %ld, %ld mm (%ld ms on)\n",
+           (unsigned long)dr_updates, (unsigned long)cycles, (long)pos.lat, (long)pos.lon, (long)pos.height,
+           (long)(pos.age_us / 1000));
+    if (dr_errors[0].count == 0)
+        return;
+    printf("  error at the next fix, %lu fixes %lu ms apart on average:\n", (unsigned long)dr_errors[0].count,
+           (unsigned long)(dr_gap_ms / dr_errors[0].count));
+    for (int m = 0; m < 3; m++) {
+        const dr_error_t *err = &dr_errors[m];
+        printf("  %-24s horizontal %lu mm avg / %lu max, vertical %lu mm avg / %lu max\n", models[m],
+               (unsigned long)(err->sum_h / err->count), (unsigned long)err->max_h,
+               (unsigned long)(err->sum_v / err->count), (unsigned long)err->max_v);
+    }
+}